@@ -0,0 +1,196 @@
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/flash.h"
+#include "hardware/flash.h"
+
+#include "config.h"
+#include "x68k_link.h"
+
+// Sector 0 is the last one, sector 1 the one below it
+#define CONFIG_FLASH_OFFSET         (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+#define CONFIG_SECTORS              2
+#define CONFIG_SLOTS                (FLASH_SECTOR_SIZE / CONFIG_PAGE_SIZE)
+
+#define CONFIG_NO_ERASE             0xffffffff
+
+// Timeout for getting the other core out of the way, it may be in an ISR
+#define CONFIG_LOCKOUT_MS           10
+
+// How long the X68000 link has to be quiet for a program, and for one with an erase
+#define CONFIG_PROGRAM_QUIET_US     10000
+#define CONFIG_ERASE_QUIET_US       2000000
+
+static X68kConfig const defaultConfig =
+{
+    .magic              = CONFIG_MAGIC,
+    .version            = CONFIG_VERSION,
+    .size               = sizeof(X68kConfig),
+    .repeatDelayMs      = 500,
+    .repeatIntervalMs   = 110,
+    .mouseScale         = MOUSE_SCALE,
+    .commit             = CONFIG_COMMIT,
+};
+
+// Flash offsets, done in this order
+typedef struct
+{
+    uint32_t eraseBefore;
+    uint32_t program;
+    uint32_t eraseAfter;
+} ConfigWrite;
+
+static X68kConfig pendingConfig;
+static bool savePending             = false;
+
+static uint32_t sectorOffset(uint32_t sector)
+{
+    return CONFIG_FLASH_OFFSET - sector * FLASH_SECTOR_SIZE;
+}
+
+static X68kConfig const* configSlot(uint32_t sector, uint32_t slot)
+{
+    return (X68kConfig const*)(XIP_BASE + sectorOffset(sector) + slot * CONFIG_PAGE_SIZE);
+}
+
+static bool isComplete(X68kConfig const* config)
+{
+    return config->magic == CONFIG_MAGIC && config->commit == CONFIG_COMMIT;
+}
+
+static bool isErased(X68kConfig const* config)
+{
+    return config->magic == 0xffffffff;
+}
+
+// Slots are used in order, so the first erased one is the next free one
+static uint32_t firstErased(uint32_t sector)
+{
+    uint32_t slot = 0;
+    while (slot < CONFIG_SLOTS && !isErased(configSlot(sector, slot)))
+        ++slot;
+    return slot;
+}
+
+static bool isSectorErased(uint32_t sector)
+{
+    for (uint32_t slot = 0; slot < CONFIG_SLOTS; ++slot)
+    {
+        if (!isErased(configSlot(sector, slot)))
+            return false;
+    }
+    return true;
+}
+
+// Values the rest of the firmware can take as they are. Macros are checked by macroLoad().
+static bool isValid(X68kConfig const* config)
+{
+    if (config->version != CONFIG_VERSION || config->size != sizeof(X68kConfig))
+        return false;
+
+    if (config->repeatDelayMs < CONFIG_REPEAT_DELAY_MIN_MS || config->repeatDelayMs > CONFIG_REPEAT_DELAY_MAX_MS ||
+        config->repeatIntervalMs < CONFIG_REPEAT_INTERVAL_MIN_MS ||
+        config->repeatIntervalMs > CONFIG_REPEAT_INTERVAL_MAX_MS ||
+        config->mouseScale < CONFIG_MOUSE_SCALE_MIN || config->mouseScale > CONFIG_MOUSE_SCALE_MAX)
+        return false;
+
+    if (config->keyRemapCount > CONFIG_KEY_REMAPS || config->dumpChordModifiers > 0x0f)
+        return false;
+
+    // Scancodes are 7 bit, bit 7 is BREAK
+    for (uint32_t i = 0; i < config->keyRemapCount; ++i)
+    {
+        if (config->keyRemaps[i].scan > 0x7f)
+            return false;
+    }
+    return true;
+}
+
+// The complete record with the highest sequence, and its sector; with 'validOnly' the newest
+// one that also passes isValid()
+static X68kConfig const* findNewest(uint32_t* sector, bool validOnly)
+{
+    X68kConfig const* newest = NULL;
+    *sector = 0;
+    for (uint32_t s = 0; s < CONFIG_SECTORS; ++s)
+    {
+        for (uint32_t slot = 0; slot < CONFIG_SLOTS && !isErased(configSlot(s, slot)); ++slot)
+        {
+            X68kConfig const* config = configSlot(s, slot);
+            if (isComplete(config) && (!validOnly || isValid(config)) &&
+                (!newest || config->sequence >= newest->sequence))
+            {
+                newest = config;
+                *sector = s;
+            }
+        }
+    }
+    return newest;
+}
+
+X68kConfig const* configLoad(void)
+{
+    // A bad record (corrupt, or from other firmware) falls back to the one before it
+    uint32_t sector;
+    X68kConfig const* newest = findNewest(&sector, true);
+    return newest ? newest : &defaultConfig;
+}
+
+void configSave(X68kConfig const* config)
+{
+    pendingConfig = *config;
+    pendingConfig.magic = CONFIG_MAGIC;
+    pendingConfig.version = CONFIG_VERSION;
+    pendingConfig.size = sizeof(X68kConfig);
+    pendingConfig.commit = CONFIG_COMMIT;
+    pendingConfig.sequence = configLoad()->sequence;
+    savePending = memcmp(&pendingConfig, configLoad(), sizeof(X68kConfig)) != 0;
+}
+
+// Runs with XIP off and the other core locked out, so from RAM only
+static void __not_in_flash_func(writeConfig)(void* param)
+{
+    ConfigWrite const* write = param;
+    if (write->eraseBefore != CONFIG_NO_ERASE)
+        flash_range_erase(write->eraseBefore, FLASH_SECTOR_SIZE);
+    flash_range_program(write->program, (uint8_t const*)&pendingConfig, CONFIG_PAGE_SIZE);
+    if (write->eraseAfter != CONFIG_NO_ERASE)
+        flash_range_erase(write->eraseAfter, FLASH_SECTOR_SIZE);
+}
+
+bool configService(bool idle, uint32_t linkQuietUs)
+{
+    if (!savePending || !idle || linkQuietUs < CONFIG_PROGRAM_QUIET_US)
+        return savePending;
+
+    // Past any bad record too, so the new one always comes out newest
+    uint32_t sector;
+    X68kConfig const* newest = findNewest(&sector, false);
+    pendingConfig.sequence = newest ? newest->sequence + 1 : 1;
+
+    ConfigWrite write = { CONFIG_NO_ERASE, 0, CONFIG_NO_ERASE };
+    uint32_t slot = firstErased(sector);
+    if (slot < CONFIG_SLOTS)
+    {
+        write.program = sectorOffset(sector) + slot * CONFIG_PAGE_SIZE;
+    }
+    else
+    {
+        // Full: start over in the other sector, and drop this one once the new record is
+        // complete. The other one can still hold older records from a move cut short.
+        uint32_t other = sector ^ 1;
+        if (!isSectorErased(other))
+            write.eraseBefore = sectorOffset(other);
+        write.program = sectorOffset(other);
+        write.eraseAfter = sectorOffset(sector);
+    }
+
+    if (linkQuietUs < CONFIG_ERASE_QUIET_US &&
+        (write.eraseBefore != CONFIG_NO_ERASE || write.eraseAfter != CONFIG_NO_ERASE))
+        return savePending;
+
+    // Keep retrying on the next idle pass if the other core couldn't be paused
+    if (flash_safe_execute(writeConfig, &write, CONFIG_LOCKOUT_MS) == PICO_OK)
+        savePending = false;
+
+    return savePending;
+}
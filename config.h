@@ -0,0 +1,89 @@
+#ifndef _CONFIG_H_
+#define _CONFIG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Settings kept in the last two flash sectors, so one binary can be set up differently per site.
+//
+// Each sector holds CONFIG_SLOTS records of one flash page each. Saving programs the next
+// erased slot of the sector in use. Once that one is full, the record goes into the other
+// (erased) sector, and the full one is only erased after that. At boot the complete record
+// with the highest 'sequence' is used in place through XIP, there is nothing to parse: 'magic'
+// is the first word programmed and 'commit' the last, so a record cut short by a power loss is
+// ignored and the previous one still counts, as does the old sector if the move was cut short.
+// Without any record, the built-in defaults apply.
+//
+// A record can also be written from the host, e.g. "picotool load config.bin -o <offset>",
+// with the offset as CONFIG_FLASH_OFFSET in config.c (the last sector), and the other sector
+// erased or a lower 'sequence' in it.
+
+#define CONFIG_MAGIC                0x47464358  // "XCFG"
+#define CONFIG_COMMIT               0x4b4f4358  // "XCOK"
+#define CONFIG_VERSION              1
+
+#define CONFIG_PAGE_SIZE            256
+#define CONFIG_KEY_REMAPS           32
+#define CONFIG_MACRO_BYTES          128
+
+// Accepted values; a record with anything outside is skipped like an incomplete one. The
+// repeat ranges are the ones the X68000 commands can set.
+#define CONFIG_REPEAT_DELAY_MIN_MS      200
+#define CONFIG_REPEAT_DELAY_MAX_MS      1700
+#define CONFIG_REPEAT_INTERVAL_MIN_MS   30
+#define CONFIG_REPEAT_INTERVAL_MAX_MS   1155
+#define CONFIG_MOUSE_SCALE_MIN          16      // 1:16
+#define CONFIG_MOUSE_SCALE_MAX          4096    // 16:1
+
+typedef struct
+{
+    uint8_t usage;                  // HID keyboard page usage
+    uint8_t scan;                   // X68000 scancode, 0x00 = no key
+} ConfigKeyRemap;
+
+// Little endian, one flash page. New fields go before 'reserved'. If 0 can mean "the built-in
+// default" they can use the space as is (older records have zeros there), otherwise bump
+// CONFIG_VERSION; a record with another version is treated as missing.
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;                  // sizeof(X68kConfig)
+
+    uint16_t repeatDelayMs;         // until the X68000 sends its own
+    uint16_t repeatIntervalMs;
+    uint16_t mouseScale;            // 8.8 fixed point, see MOUSE_SCALE
+    uint8_t  keyRemapCount;
+    uint8_t  pad;
+    ConfigKeyRemap keyRemaps[CONFIG_KEY_REMAPS];    // on top of the built-in keyScans[]
+
+    // Stats dump chord (see hid_translate.h), 0 = the built-in one
+    uint8_t  dumpChordModifiers;    // HID_CHORD_xxx
+    uint8_t  dumpChordKey;          // HID keyboard page usage
+
+    uint8_t  macros[CONFIG_MACRO_BYTES];    // see macro.h, all 0 = none
+
+    uint16_t pad2;
+    uint32_t sequence;              // one up per save, the highest is the newest record
+
+    uint8_t  reserved[CONFIG_PAGE_SIZE - 92 - CONFIG_MACRO_BYTES];
+    uint32_t commit;
+} X68kConfig;
+
+_Static_assert(sizeof(X68kConfig) == CONFIG_PAGE_SIZE, "X68kConfig must be one flash page");
+
+// The newest valid record in flash, or the built-in defaults
+X68kConfig const* configLoad(void);
+
+// Makes 'config' the one to save. Nothing is written until configService() gets to run idle.
+void configSave(X68kConfig const* config);
+
+// Call from the main loop, with 'idle' true when nothing is going on on the USB side, and
+// 'linkQuietUs' how long the X68000 link has been quiet (0 while anything is on the lines).
+// A flash write stops both cores: ~1 ms to program a record, less than one byte on the keyboard
+// line, but ~50 ms more when a full sector has to be erased. That's longer than the gap
+// between MSCTRL polls, so erases wait until the X68000 has stopped polling for a while.
+// Returns true while a save is still pending.
+bool configService(bool idle, uint32_t linkQuietUs);
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef _EVENT_RING_H_
+#define _EVENT_RING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// Single-producer/single-consumer ring of input events. This is the one interface between
+// the USB side (TinyUSB callbacks, already translated to X68000 scancodes) and the X68000
+// side (keyboard/mouse UARTs), which may be running on the other core.
+// 'head' is only written by the producer, 'tail' only by the consumer.
+
+#define EVENT_KEY               1   // scan = X68000 scancode, bit 7 set for BREAK
+#define EVENT_MOUSE             2   // dx/dy = motion since the last event, buttons = current state
+#define EVENT_MACRO             3   // scan = macro index (see macro.h), bit 7 set when its key is released
+
+#define EVENT_FLAG_REPEAT       0x01    // EVENT_KEY: this MAKE may auto-repeat
+
+typedef struct
+{
+    uint32_t timestamp;         // time_us_32() when the HID report arrived
+    uint8_t  type;
+    uint8_t  flags;
+    union
+    {
+        uint8_t scan;
+        uint8_t buttons;
+    };
+    int16_t  dx;
+    int16_t  dy;
+} InputEvent;
+
+#define EVENT_RING_SIZE         64  // must be a power of two
+#define EVENT_RING_MASK         (EVENT_RING_SIZE - 1)
+
+typedef struct
+{
+    InputEvent  events[EVENT_RING_SIZE];
+    atomic_uint head;
+    atomic_uint tail;
+
+    // Written by the producer only
+    uint32_t    keyOverflows;   // keyboard reports held back for lack of space
+    uint32_t    mouseOverflows; // mouse events merged into a later one for lack of space
+    uint32_t    highWater;      // most events ever waiting at once
+} EventRing;
+
+static inline uint32_t eventRingCount(EventRing* ring)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    return head - tail;
+}
+
+static inline uint32_t eventRingFree(EventRing* ring)
+{
+    return EVENT_RING_SIZE - eventRingCount(ring);
+}
+
+// Producer side
+static inline bool eventRingPush(EventRing* ring, InputEvent const* event)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail >= EVENT_RING_SIZE)
+        return false;
+
+    ring->events[head & EVENT_RING_MASK] = *event;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    if (head + 1 - tail > ring->highWater)
+        ring->highWater = head + 1 - tail;
+    return true;
+}
+
+// Consumer side; the event stays in the ring until eventRingPop(), so the consumer can
+// leave it there if the output it's headed for is full
+static inline InputEvent const* eventRingPeek(EventRing* ring)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (head == tail)
+        return NULL;
+
+    return &ring->events[tail & EVENT_RING_MASK];
+}
+
+static inline void eventRingPop(EventRing* ring)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+#endif
@@ -0,0 +1,82 @@
+#include <string.h>
+
+#include "hid_capture.h"
+
+#define HID_CAPTURE_MASK            (HID_CAPTURE_SIZE - 1)
+
+// Written and read from the same core (the TinyUSB callbacks and the main loop)
+static uint8_t captureRing[HID_CAPTURE_SIZE];
+static uint32_t captureHead         = 0;
+static uint32_t captureTail         = 0;
+static uint32_t captureDropped      = 0;
+
+static uint8_t const captureHeader[] = { 'X', '6', 'H', 'C', HID_CAPTURE_VERSION };
+static bool captureHeaderSent       = false;
+
+static void putBytes(uint8_t const* bytes, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; ++i)
+        captureRing[(captureHead + i) & HID_CAPTURE_MASK] = bytes[i];
+    captureHead += len;
+}
+
+void hidCaptureRecord(uint8_t type, uint8_t devAddr, uint8_t instance, uint32_t timestamp,
+                      uint8_t const* prefix, uint16_t prefixLen, uint8_t const* data, uint16_t len)
+{
+    uint32_t total = (uint32_t)prefixLen + len;
+    if (total > HID_CAPTURE_MAX_DATA)
+    {
+        type |= HID_CAPTURE_TRUNCATED;
+        len = HID_CAPTURE_MAX_DATA - prefixLen;
+        total = HID_CAPTURE_MAX_DATA;
+    }
+
+    if (HID_CAPTURE_HEADER_SIZE + total > HID_CAPTURE_SIZE - (captureHead - captureTail))
+    {
+        ++captureDropped;
+        return;
+    }
+
+    uint8_t header[HID_CAPTURE_HEADER_SIZE] =
+    {
+        type, devAddr, instance,
+        total & 0xff, total >> 8,
+        timestamp & 0xff, (timestamp >> 8) & 0xff, (timestamp >> 16) & 0xff, timestamp >> 24,
+    };
+
+    putBytes(header, sizeof(header));
+    putBytes(prefix, prefixLen);
+    putBytes(data, len);
+}
+
+uint32_t hidCaptureNext(uint8_t* record)
+{
+    if (!captureHeaderSent)
+    {
+        memcpy(record, captureHeader, sizeof(captureHeader));
+        return sizeof(captureHeader);
+    }
+
+    if (captureHead == captureTail)
+        return 0;
+
+    uint32_t len = captureRing[(captureTail + 3) & HID_CAPTURE_MASK] |
+                   (captureRing[(captureTail + 4) & HID_CAPTURE_MASK] << 8);
+    uint32_t size = HID_CAPTURE_HEADER_SIZE + len;
+    for (uint32_t i = 0; i < size; ++i)
+        record[i] = captureRing[(captureTail + i) & HID_CAPTURE_MASK];
+    return size;
+}
+
+void hidCaptureConsume(uint32_t size)
+{
+    if (!captureHeaderSent)
+        captureHeaderSent = true;
+    else
+        captureTail += size;
+}
+
+uint32_t hidCaptureDropped(void)
+{
+    return captureDropped;
+}
@@ -0,0 +1,57 @@
+#ifndef _HID_CAPTURE_H_
+#define _HID_CAPTURE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Capture of the raw USB HID traffic (mounts with their report descriptor, reports, unmounts)
+// into a byte ring in SRAM, streamed out from the main loop one whole record at a time. The
+// stream can be fed straight to the host replay tool (host/replay.c).
+//
+// Stream format, little endian:
+//   "X6HC" HID_CAPTURE_VERSION
+//   then one record per event:
+//     uint8  type          HID_CAPTURE_xxx, ORed with HID_CAPTURE_TRUNCATED if data[] was cut
+//     uint8  devAddr
+//     uint8  instance
+//     uint16 len           of data[]
+//     uint32 timestamp     time_us_32()
+//     uint8  data[len]     MOUNT: itfProtocol, report descriptor; REPORT: the report
+//
+// data[] holds up to HID_CAPTURE_MAX_DATA bytes. Anything longer (in practice only the report
+// descriptors of some gaming and composite keyboards) is cut there and flagged, so the mount
+// is still in the capture and replay can say the layout it parses may be incomplete.
+
+#define HID_CAPTURE_MAGIC           "X6HC"
+#define HID_CAPTURE_VERSION         2       // 1 had no HID_CAPTURE_TRUNCATED
+
+#define HID_CAPTURE_MOUNT           1
+#define HID_CAPTURE_UMOUNT          2
+#define HID_CAPTURE_REPORT          3
+#define HID_CAPTURE_TYPE_MASK       0x7f
+#define HID_CAPTURE_TRUNCATED       0x80
+
+#define HID_CAPTURE_HEADER_SIZE     9
+#ifndef HID_CAPTURE_MAX_DATA
+#define HID_CAPTURE_MAX_DATA        1024
+#endif
+#define HID_CAPTURE_MAX_RECORD      (HID_CAPTURE_HEADER_SIZE + HID_CAPTURE_MAX_DATA)
+
+#ifndef HID_CAPTURE_SIZE
+#define HID_CAPTURE_SIZE            16384   // must be a power of two
+#endif
+
+// Producer side. Records that don't fit in the ring are dropped whole and counted, capture
+// never waits; data past HID_CAPTURE_MAX_DATA is cut off (see above).
+void hidCaptureRecord(uint8_t type, uint8_t devAddr, uint8_t instance, uint32_t timestamp,
+                      uint8_t const* prefix, uint16_t prefixLen, uint8_t const* data, uint16_t len);
+
+// Consumer side: copies the next record (the stream header first) into 'record', which holds
+// HID_CAPTURE_MAX_RECORD bytes, and returns its size, or 0 if there's none. It stays the next
+// one until hidCaptureConsume() is called with that size, once it's been sent.
+uint32_t hidCaptureNext(uint8_t* record);
+void hidCaptureConsume(uint32_t size);
+
+uint32_t hidCaptureDropped(void);
+
+#endif
@@ -0,0 +1,498 @@
+#include <string.h>
+
+#include "hid_parser.h"
+
+// A minimal HID 1.11 report descriptor walker. It only tracks what is needed to locate
+// keyboard (modifiers, key array or NKRO bitmap), mouse (buttons, X, Y, wheel) and gamepad
+// (buttons, hat switch, two sticks) input fields, and the keyboard LED output field, and
+// turns them into bit offsets so the report callback never has to parse.
+
+#define HID_MAX_USAGES          16
+#define HID_MAX_REPORT_IDS      16
+#define HID_MAX_GLOBAL_STACK    4
+#define HID_MAX_FIELD_BITS      24
+#define HID_MAX_AXIS_BITS       16      // so the deflection can be scaled in 32 bits
+
+// Item types and tags, see HID 1.11 chapter 6.2.2
+#define ITEM_MAIN               0
+#define ITEM_GLOBAL             1
+#define ITEM_LOCAL              2
+
+#define MAIN_INPUT              0x8
+#define MAIN_OUTPUT             0x9
+#define MAIN_COLLECTION         0xa
+#define MAIN_END_COLLECTION     0xc
+
+#define GLOBAL_USAGE_PAGE       0x0
+#define GLOBAL_LOGICAL_MIN      0x1
+#define GLOBAL_LOGICAL_MAX      0x2
+#define GLOBAL_REPORT_SIZE      0x7
+#define GLOBAL_REPORT_ID        0x8
+#define GLOBAL_REPORT_COUNT     0x9
+#define GLOBAL_PUSH             0xa
+#define GLOBAL_POP              0xb
+
+#define LOCAL_USAGE             0x0
+#define LOCAL_USAGE_MIN         0x1
+#define LOCAL_USAGE_MAX         0x2
+
+#define INPUT_CONSTANT          0x01
+#define INPUT_VARIABLE          0x02
+
+#define COLLECTION_APPLICATION  0x01
+
+// Usages as (page << 16 | id)
+#define USAGE_PAGE(u)           ((u) >> 16)
+#define USAGE_ID(u)             ((u) & 0xffff)
+
+#define PAGE_GENERIC_DESKTOP    0x01
+#define PAGE_KEYBOARD           0x07
+#define PAGE_LED                0x08
+#define PAGE_BUTTON             0x09
+
+#define GD_POINTER              0x00010001
+#define GD_MOUSE                0x00010002
+#define GD_JOYSTICK             0x00010004
+#define GD_GAMEPAD              0x00010005
+#define GD_KEYBOARD             0x00010006
+#define GD_KEYPAD               0x00010007
+#define GD_X                    0x30
+#define GD_Y                    0x31
+#define GD_Z                    0x32
+#define GD_RX                   0x33
+#define GD_RY                   0x34
+#define GD_RZ                   0x35
+#define GD_WHEEL                0x38
+#define GD_HAT_SWITCH           0x39
+
+#define KEY_LEFTCTRL            0xe0
+
+typedef struct
+{
+    uint16_t usagePage;
+    int32_t  logicalMin;
+    int32_t  logicalMax;
+    uint32_t reportSize;
+    uint32_t reportCount;
+    uint8_t  reportId;
+} GlobalState;
+
+typedef struct
+{
+    uint32_t usages[HID_MAX_USAGES];
+    uint8_t  usageCount;
+    uint32_t usageMin;
+    uint32_t usageMax;
+    bool     hasRange;
+} LocalState;
+
+typedef struct
+{
+    uint8_t  id;
+    uint16_t bits;
+} ReportOffset;
+
+static uint32_t getUsage(LocalState const* local, uint32_t index)
+{
+    uint32_t count = local->usageCount;
+    if (count)
+        return local->usages[index < count ? index : count - 1];
+
+    if (local->hasRange)
+    {
+        uint32_t usage = local->usageMin + index;
+        return usage <= local->usageMax ? usage : local->usageMax;
+    }
+
+    return 0;
+}
+
+static uint16_t* getReportOffset(ReportOffset* offsets, uint8_t* numOffsets, uint8_t reportId)
+{
+    for (int i = 0; i < *numOffsets; ++i)
+    {
+        if (offsets[i].id == reportId)
+            return &offsets[i].bits;
+    }
+
+    if (*numOffsets == HID_MAX_REPORT_IDS)
+        return NULL;
+
+    ReportOffset* entry = &offsets[(*numOffsets)++];
+    entry->id = reportId;
+    entry->bits = reportId ? 8 : 0;     // skip the report ID byte
+    return &entry->bits;
+}
+
+// All fields of one layout have to come from the same report
+static bool claimReportId(uint8_t* owner, bool claimed, uint8_t reportId)
+{
+    if (claimed)
+        return *owner == reportId;
+
+    *owner = reportId;
+    return true;
+}
+
+static void setField(HidField* field, uint32_t bitOffset, uint32_t bitSize, bool isSigned)
+{
+    field->bitOffset = bitOffset;
+    field->bitSize = bitSize;
+    field->isSigned = isSigned;
+}
+
+static void parseKeyboardInput(HidKeybLayout* keyb, uint8_t* flags, GlobalState const* global,
+                               LocalState const* local, uint32_t inputFlags, uint32_t bitOffset)
+{
+    uint32_t firstUsage = getUsage(local, 0);
+    uint16_t page = firstUsage ? USAGE_PAGE(firstUsage) : global->usagePage;
+
+    if (page != PAGE_KEYBOARD || global->reportSize > HID_MAX_FIELD_BITS)
+        return;
+
+    bool claimed = keyb->modifiers.bitSize || keyb->keys.bitSize || keyb->keyBitmap.bitSize;
+    if (!claimReportId(&keyb->reportId, claimed, global->reportId))
+        return;
+
+    if (inputFlags & INPUT_VARIABLE)
+    {
+        if (global->reportSize != 1)
+            return;
+
+        if (USAGE_ID(firstUsage) == KEY_LEFTCTRL && global->reportCount >= 8)
+        {
+            if (!keyb->modifiers.bitSize)
+                setField(&keyb->modifiers, bitOffset, 8, false);
+        }
+        else if (!keyb->keyBitmap.bitSize && USAGE_ID(firstUsage) < KEY_LEFTCTRL)
+        {
+            setField(&keyb->keyBitmap, bitOffset, 1, false);
+            keyb->keyBitmapMin = USAGE_ID(firstUsage);
+            keyb->keyBitmapCount = global->reportCount;
+            if (keyb->keyBitmapMin + keyb->keyBitmapCount > KEY_LEFTCTRL)
+                keyb->keyBitmapCount = KEY_LEFTCTRL - keyb->keyBitmapMin;
+        }
+        else
+        {
+            return;
+        }
+    }
+    else
+    {
+        if (keyb->keys.bitSize)
+            return;
+
+        setField(&keyb->keys, bitOffset, global->reportSize, false);
+        keyb->keyCount = global->reportCount < 0xff ? global->reportCount : 0xff;
+    }
+
+    *flags |= HID_LAYOUT_KEYBOARD;
+}
+
+static void parseKeyboardOutput(HidKeybLayout* keyb, GlobalState const* global, LocalState const* local,
+                                uint32_t outputFlags, uint32_t bitOffset)
+{
+    uint32_t firstUsage = getUsage(local, 0);
+    uint16_t page = firstUsage ? USAGE_PAGE(firstUsage) : global->usagePage;
+
+    if (page != PAGE_LED || !(outputFlags & INPUT_VARIABLE) || global->reportSize != 1 || keyb->leds.bitSize)
+        return;
+
+    keyb->ledReportId = global->reportId;
+    keyb->ledUsageMin = USAGE_ID(firstUsage);
+    setField(&keyb->leds, bitOffset, global->reportCount < 8 ? global->reportCount : 8, false);
+}
+
+static void parseMouseInput(HidMouseLayout* mouse, uint8_t* flags, GlobalState const* global,
+                            LocalState const* local, uint32_t inputFlags, uint32_t bitOffset)
+{
+    if (!(inputFlags & INPUT_VARIABLE) || global->reportSize > HID_MAX_FIELD_BITS)
+        return;
+
+    bool claimed = mouse->buttons.bitSize || mouse->x.bitSize || mouse->y.bitSize || mouse->wheel.bitSize;
+    if (!claimReportId(&mouse->reportId, claimed, global->reportId))
+        return;
+
+    bool isSigned = global->logicalMin < 0;
+
+    for (uint32_t i = 0; i < global->reportCount; ++i)
+    {
+        uint32_t usage = getUsage(local, i);
+        uint32_t fieldOffset = bitOffset + i * global->reportSize;
+
+        if (!(usage >> 16))
+            usage |= (uint32_t)global->usagePage << 16;
+
+        if (USAGE_PAGE(usage) == PAGE_BUTTON)
+        {
+            if (!mouse->buttons.bitSize && USAGE_ID(usage) == 1 && global->reportSize == 1)
+            {
+                uint32_t count = global->reportCount - i;
+                setField(&mouse->buttons, fieldOffset, count < 16 ? count : 16, false);
+            }
+        }
+        else if (USAGE_PAGE(usage) == PAGE_GENERIC_DESKTOP && global->reportSize >= 2)
+        {
+            HidField* field = NULL;
+            switch (USAGE_ID(usage))
+            {
+                case GD_X:      field = &mouse->x;      break;
+                case GD_Y:      field = &mouse->y;      break;
+                case GD_WHEEL:  field = &mouse->wheel;  break;
+            }
+
+            if (field && !field->bitSize)
+                setField(field, fieldOffset, global->reportSize, isSigned);
+        }
+    }
+
+    if (mouse->x.bitSize && mouse->y.bitSize)
+        *flags |= HID_LAYOUT_MOUSE;
+}
+
+static void setAxis(HidAxis* axis, uint32_t bitOffset, GlobalState const* global)
+{
+    if (axis->field.bitSize || global->logicalMax <= global->logicalMin || global->reportSize > HID_MAX_AXIS_BITS ||
+        global->logicalMin < INT16_MIN || global->logicalMax > UINT16_MAX)
+        return;
+
+    setField(&axis->field, bitOffset, global->reportSize, global->logicalMin < 0);
+    axis->center = global->logicalMin + (global->logicalMax - global->logicalMin + 1) / 2;
+    axis->half = (global->logicalMax - global->logicalMin + 1) / 2;
+}
+
+static void parseGamepadInput(HidGamepadLayout* pad, uint8_t* flags, GlobalState const* global,
+                              LocalState const* local, uint32_t inputFlags, uint32_t bitOffset)
+{
+    if (!(inputFlags & INPUT_VARIABLE) || global->reportSize > HID_MAX_FIELD_BITS)
+        return;
+
+    bool claimed = pad->buttons.bitSize || pad->hat.bitSize || pad->x.field.bitSize || pad->y.field.bitSize ||
+                   pad->rx.field.bitSize || pad->ry.field.bitSize;
+    if (!claimReportId(&pad->reportId, claimed, global->reportId))
+        return;
+
+    for (uint32_t i = 0; i < global->reportCount; ++i)
+    {
+        uint32_t usage = getUsage(local, i);
+        uint32_t fieldOffset = bitOffset + i * global->reportSize;
+
+        if (!(usage >> 16))
+            usage |= (uint32_t)global->usagePage << 16;
+
+        if (USAGE_PAGE(usage) == PAGE_BUTTON)
+        {
+            if (!pad->buttons.bitSize && USAGE_ID(usage) == 1 && global->reportSize == 1)
+            {
+                uint32_t count = global->reportCount - i;
+                setField(&pad->buttons, fieldOffset, count < 16 ? count : 16, false);
+            }
+        }
+        else if (USAGE_PAGE(usage) == PAGE_GENERIC_DESKTOP)
+        {
+            switch (USAGE_ID(usage))
+            {
+                case GD_X:      setAxis(&pad->x, fieldOffset, global);  break;
+                case GD_Y:      setAxis(&pad->y, fieldOffset, global);  break;
+                case GD_Z:
+                case GD_RX:     setAxis(&pad->rx, fieldOffset, global); break;
+                case GD_RZ:
+                case GD_RY:     setAxis(&pad->ry, fieldOffset, global); break;
+                case GD_HAT_SWITCH:
+                    if (!pad->hat.bitSize && global->reportSize >= 3)
+                    {
+                        setField(&pad->hat, fieldOffset, global->reportSize, global->logicalMin < 0);
+                        pad->hatMin = global->logicalMin;
+                    }
+                    break;
+            }
+        }
+    }
+
+    if (pad->buttons.bitSize || pad->hat.bitSize || pad->x.field.bitSize)
+        *flags |= HID_LAYOUT_GAMEPAD;
+}
+
+bool hidParseReportDescriptor(uint8_t const* desc, uint16_t descLen, HidLayout* layout)
+{
+    memset(layout, 0, sizeof(*layout));
+
+    GlobalState global = { 0 };
+    GlobalState globalStack[HID_MAX_GLOBAL_STACK];
+    uint8_t globalDepth = 0;
+    LocalState local = { 0 };
+
+    ReportOffset offsets[HID_MAX_REPORT_IDS];
+    uint8_t numOffsets = 0;
+    ReportOffset outputOffsets[HID_MAX_REPORT_IDS];
+    uint8_t numOutputOffsets = 0;
+
+    uint32_t application = 0;
+    uint32_t collectionDepth = 0;
+
+    uint16_t i = 0;
+    while (i < descLen)
+    {
+        uint8_t prefix = desc[i++];
+
+        // Long items are reserved and never used for input fields
+        if (prefix == 0xfe)
+        {
+            if (i + 1 >= descLen)
+                break;
+            i += 2 + desc[i];
+            continue;
+        }
+
+        uint8_t size = prefix & 0x03;
+        if (size == 3)
+            size = 4;
+        uint8_t type = (prefix >> 2) & 0x03;
+        uint8_t tag = prefix >> 4;
+
+        if (i + size > descLen)
+            break;
+
+        uint32_t value = 0;
+        for (int b = 0; b < size; ++b)
+            value |= (uint32_t)desc[i + b] << (8 * b);
+        int32_t signedValue = value;
+        if (size && size < 4 && (value & (1u << (size * 8 - 1))))
+            signedValue = value | ~((1u << (size * 8)) - 1);
+        i += size;
+
+        if (type == ITEM_GLOBAL)
+        {
+            switch (tag)
+            {
+                case GLOBAL_USAGE_PAGE:     global.usagePage = value; break;
+                case GLOBAL_LOGICAL_MIN:    global.logicalMin = signedValue; break;
+                // Plenty of pads have 0..255 as a signed 1-byte item, i.e. 0..-1
+                case GLOBAL_LOGICAL_MAX:
+                    global.logicalMax = signedValue < global.logicalMin ? (int32_t)value : signedValue;
+                    break;
+                case GLOBAL_REPORT_SIZE:    global.reportSize = value; break;
+                case GLOBAL_REPORT_ID:      global.reportId = value; break;
+                case GLOBAL_REPORT_COUNT:   global.reportCount = value; break;
+                case GLOBAL_PUSH:
+                    if (globalDepth < HID_MAX_GLOBAL_STACK)
+                        globalStack[globalDepth++] = global;
+                    break;
+                case GLOBAL_POP:
+                    if (globalDepth)
+                        global = globalStack[--globalDepth];
+                    break;
+            }
+        }
+        else if (type == ITEM_LOCAL)
+        {
+            // 4-byte usages carry their own page
+            uint32_t usage = size == 4 ? value : ((uint32_t)global.usagePage << 16) | value;
+
+            switch (tag)
+            {
+                case LOCAL_USAGE:
+                    if (local.usageCount < HID_MAX_USAGES)
+                        local.usages[local.usageCount++] = usage;
+                    break;
+                case LOCAL_USAGE_MIN:
+                    local.usageMin = usage;
+                    local.hasRange = true;
+                    break;
+                case LOCAL_USAGE_MAX:
+                    local.usageMax = usage;
+                    local.hasRange = true;
+                    break;
+            }
+        }
+        else if (type == ITEM_MAIN)
+        {
+            if (tag == MAIN_COLLECTION)
+            {
+                if (collectionDepth == 0 && value == COLLECTION_APPLICATION)
+                    application = getUsage(&local, 0);
+                ++collectionDepth;
+            }
+            else if (tag == MAIN_END_COLLECTION)
+            {
+                if (collectionDepth)
+                    --collectionDepth;
+            }
+            else if (tag == MAIN_INPUT)
+            {
+                uint16_t* offset = getReportOffset(offsets, &numOffsets, global.reportId);
+                uint32_t bits = global.reportSize * global.reportCount;
+
+                // Out of report ID slots, or a nonsensical report size - stop here
+                if (!offset || *offset + bits > 0xffff)
+                    break;
+
+                if (!(value & INPUT_CONSTANT))
+                {
+                    if (application == GD_KEYBOARD || application == GD_KEYPAD)
+                        parseKeyboardInput(&layout->keyb, &layout->flags, &global, &local, value, *offset);
+                    else if (application == GD_MOUSE || application == GD_POINTER)
+                        parseMouseInput(&layout->mouse, &layout->flags, &global, &local, value, *offset);
+                    else if (application == GD_JOYSTICK || application == GD_GAMEPAD)
+                        parseGamepadInput(&layout->pad, &layout->flags, &global, &local, value, *offset);
+                }
+
+                *offset += bits;
+            }
+            else if (tag == MAIN_OUTPUT)
+            {
+                // Output reports are numbered separately from the input ones
+                uint16_t* offset = getReportOffset(outputOffsets, &numOutputOffsets, global.reportId);
+                uint32_t bits = global.reportSize * global.reportCount;
+                if (!offset || *offset + bits > 0xffff)
+                    break;
+
+                if (!(value & INPUT_CONSTANT) && (application == GD_KEYBOARD || application == GD_KEYPAD))
+                    parseKeyboardOutput(&layout->keyb, &global, &local, value, *offset);
+
+                *offset += bits;
+            }
+
+            // Local items only apply to the next main item
+            memset(&local, 0, sizeof(local));
+        }
+    }
+
+    if (layout->keyb.leds.bitSize)
+    {
+        // The whole output report goes out, padding included
+        uint16_t* offset = getReportOffset(outputOffsets, &numOutputOffsets, layout->keyb.ledReportId);
+        uint32_t bytes = offset ? (*offset + 7) / 8 : 0;
+        layout->keyb.ledReportLen = bytes <= 8 ? bytes : 0;
+    }
+
+    return layout->flags != 0;
+}
+
+void hidBootLayout(uint8_t itfProtocol, HidLayout* layout)
+{
+    memset(layout, 0, sizeof(*layout));
+
+    if (itfProtocol == 1)           // HID_ITF_PROTOCOL_KEYBOARD
+    {
+        // modifier, reserved, keycode[6]
+        layout->flags = HID_LAYOUT_KEYBOARD;
+        setField(&layout->keyb.modifiers, 0, 8, false);
+        setField(&layout->keyb.keys, 16, 8, false);
+        layout->keyb.keyCount = 6;
+
+        // NUM LOCK, CAPS LOCK, SCROLL LOCK, COMPOSE, KANA, padding
+        setField(&layout->keyb.leds, 0, 5, false);
+        layout->keyb.ledUsageMin = 1;
+        layout->keyb.ledReportLen = 1;
+    }
+    else if (itfProtocol == 2)      // HID_ITF_PROTOCOL_MOUSE
+    {
+        // buttons, x, y, wheel
+        layout->flags = HID_LAYOUT_MOUSE;
+        setField(&layout->mouse.buttons, 0, 3, false);
+        setField(&layout->mouse.x, 8, 8, true);
+        setField(&layout->mouse.y, 16, 8, true);
+        setField(&layout->mouse.wheel, 24, 8, true);
+    }
+}
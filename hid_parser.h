@@ -0,0 +1,111 @@
+#ifndef _HID_PARSER_H_
+#define _HID_PARSER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Compact field-offset tables built once from the HID report descriptor at mount time.
+// Offsets are in bits from the start of the report as delivered by TinyUSB, i.e. they
+// already include the leading report ID byte when the device uses report IDs.
+
+typedef struct
+{
+    uint16_t bitOffset;
+    uint8_t  bitSize;       // 0 = field not present
+    uint8_t  isSigned;
+} HidField;
+
+typedef struct
+{
+    uint8_t  reportId;      // 0 = device doesn't use report IDs
+    HidField modifiers;     // 8 consecutive 1-bit usages, LEFTCTRL (0xE0) in bit 0
+    HidField keys;          // array of keyCount key usages, keys.bitSize each
+    uint8_t  keyCount;
+    HidField keyBitmap;     // NKRO style, 1 bit per usage starting at keyBitmapMin
+    uint8_t  keyBitmapMin;
+    uint16_t keyBitmapCount;
+
+    // LED output report; offsets count the report ID byte like the input ones
+    uint8_t  ledReportId;
+    uint8_t  ledReportLen;  // bytes, including the report ID; 0 = no LEDs
+    HidField leds;          // 1 bit per LED usage starting at ledUsageMin (1 = NUM LOCK)
+    uint8_t  ledUsageMin;
+} HidKeybLayout;
+
+typedef struct
+{
+    uint8_t  reportId;
+    HidField buttons;       // 1 bit per button, button 1 in bit 0
+    HidField x;
+    HidField y;
+    HidField wheel;
+} HidMouseLayout;
+
+// Absolute axis with its logical range; 'center' and 'half' are precomputed from it. Up to 16
+// bits, with the range within -32768..65535.
+typedef struct
+{
+    HidField field;
+    int32_t  center;
+    int32_t  half;          // half the range, 0 = axis not present
+} HidAxis;
+
+typedef struct
+{
+    uint8_t  reportId;
+    HidField buttons;       // 1 bit per button, button 1 in bit 0
+    HidField hat;           // 8 way, hatMin = up, clockwise; outside that range = centered
+    int32_t  hatMin;
+    HidAxis  x;             // left stick, or the D-pad on pads without a hat switch
+    HidAxis  y;
+    HidAxis  rx;            // right stick: Z/Rz, or Rx/Ry
+    HidAxis  ry;
+} HidGamepadLayout;
+
+#define HID_LAYOUT_KEYBOARD     0x01
+#define HID_LAYOUT_MOUSE        0x02
+#define HID_LAYOUT_GAMEPAD      0x04
+
+typedef struct
+{
+    uint8_t          flags; // HID_LAYOUT_xxx
+    HidKeybLayout    keyb;
+    HidMouseLayout   mouse;
+    HidGamepadLayout pad;
+} HidLayout;
+
+// Returns false if nothing usable was found
+bool hidParseReportDescriptor(uint8_t const* desc, uint16_t descLen, HidLayout* layout);
+
+// Layout for the fixed boot protocol reports (HID_ITF_PROTOCOL_KEYBOARD / _MOUSE)
+void hidBootLayout(uint8_t itfProtocol, HidLayout* layout);
+
+static inline bool hidLayoutMatches(uint8_t reportId, uint8_t const* report, uint16_t len)
+{
+    return reportId == 0 || (len && report[0] == reportId);
+}
+
+// Fields are at most 24 bits wide (enforced by the parser), so 4 bytes always cover them
+static inline int32_t hidGetField(uint8_t const* report, uint16_t len, HidField const* field)
+{
+    uint32_t byte = field->bitOffset >> 3;
+    uint32_t bits = 0;
+    for (uint32_t i = 0; i < 4 && byte + i < len; ++i)
+        bits |= (uint32_t)report[byte + i] << (8 * i);
+
+    uint32_t mask = (1u << field->bitSize) - 1;
+    bits = (bits >> (field->bitOffset & 7)) & mask;
+
+    if (field->isSigned && (bits & (1u << (field->bitSize - 1))))
+        bits |= ~mask;
+
+    return (int32_t)bits;
+}
+
+static inline bool hidGetBit(uint8_t const* report, uint16_t len, uint16_t bitOffset)
+{
+    uint32_t byte = bitOffset >> 3;
+    return byte < len && (report[byte] & (1u << (bitOffset & 7)));
+}
+
+#endif
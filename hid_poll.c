@@ -0,0 +1,125 @@
+#include <string.h>
+
+#include "hid_poll.h"
+
+// Descriptor bits used here, from the USB 2.0 spec and HID 1.11
+#define DESC_TYPE_INTERFACE         0x04
+#define DESC_TYPE_ENDPOINT          0x05
+#define USB_CLASS_HID               0x03
+#define ENDPOINT_DIR_IN             0x80
+#define ENDPOINT_XFER_INTERRUPT     0x03
+
+#define HID_ITF_PROTOCOL_KEYBOARD   1
+#define HID_ITF_PROTOCOL_MOUSE      2
+
+#define HID_POLL_KEEP               0   // table entry: use the device's own bInterval
+
+typedef struct
+{
+    uint16_t vid;
+    uint16_t pid;
+    uint8_t  intervalMs;            // HID_POLL_KEEP, or the interval for all its HID interfaces
+} HidPollOverride;
+
+// Devices that need something other than the defaults, e.g. ones that misbehave when polled
+// faster than they asked for ({ vid, pid, HID_POLL_KEEP }). Ends with vid 0.
+static HidPollOverride const pollOverrides[] =
+{
+    { 0x0000, 0x0000, 0 },
+};
+
+// Indexed like hidInstances: TinyUSB numbers the HID interfaces of a device in descriptor order
+static uint8_t pollIntervals[HID_MAX_DEVICES][HID_MAX_INSTANCES];
+static uint8_t deviceIntervals[HID_MAX_DEVICES][HID_MAX_INSTANCES];
+
+static HidPollOverride const* findOverride(uint16_t vid, uint16_t pid)
+{
+    for (HidPollOverride const* entry = pollOverrides; entry->vid; ++entry)
+    {
+        if (entry->vid == vid && entry->pid == pid)
+            return entry;
+    }
+    return NULL;
+}
+
+static uint8_t pollTarget(HidPollOverride const* entry, uint8_t itfProtocol, uint8_t bInterval)
+{
+    if (entry)
+        return entry->intervalMs == HID_POLL_KEEP ? bInterval : entry->intervalMs;
+
+    if (itfProtocol == HID_ITF_PROTOCOL_KEYBOARD || itfProtocol == HID_ITF_PROTOCOL_MOUSE)
+        return HID_POLL_FAST_MS;
+
+    return HID_POLL_OTHER_MS;
+}
+
+uint32_t hidPollPatchConfig(uint8_t devAddr, uint16_t vid, uint16_t pid, bool lowSpeed, uint8_t* desc, uint16_t len)
+{
+    if (devAddr >= HID_MAX_DEVICES)
+        return 0;
+
+    memset(pollIntervals[devAddr], 0, sizeof(pollIntervals[devAddr]));
+    memset(deviceIntervals[devAddr], 0, sizeof(deviceIntervals[devAddr]));
+
+    HidPollOverride const* entry = findOverride(vid, pid);
+    uint32_t patched = 0;
+    int instance = -1;
+    bool inHid = false;
+    uint8_t itfProtocol = 0;
+
+    for (uint16_t pos = 0; pos + 2 <= len; pos += desc[pos])
+    {
+        uint8_t const length = desc[pos];
+        uint8_t const type = desc[pos + 1];
+        if (length < 2 || pos + length > len)
+            break;
+
+        if (type == DESC_TYPE_INTERFACE && length >= 9)
+        {
+            // Only the default alternate setting gets opened
+            inHid = desc[pos + 3] == 0 && desc[pos + 5] == USB_CLASS_HID;
+            if (inHid)
+            {
+                ++instance;
+                itfProtocol = desc[pos + 7];
+            }
+        }
+        else if (type == DESC_TYPE_ENDPOINT && length >= 7 && inHid &&
+                 (desc[pos + 2] & ENDPOINT_DIR_IN) && (desc[pos + 3] & 0x03) == ENDPOINT_XFER_INTERRUPT)
+        {
+            uint8_t* bInterval = &desc[pos + 6];
+            uint8_t interval = *bInterval;
+
+            uint8_t target = pollTarget(entry, itfProtocol, interval);
+            if (lowSpeed && target < HID_POLL_LOW_SPEED_MS)
+                target = HID_POLL_LOW_SPEED_MS;
+            if (HID_POLL_OVERRIDE && target && target < interval)
+            {
+                *bInterval = target;
+                ++patched;
+            }
+
+            if (instance < HID_MAX_INSTANCES)
+            {
+                deviceIntervals[devAddr][instance] = interval;
+                pollIntervals[devAddr][instance] = *bInterval;
+            }
+        }
+    }
+
+    return patched;
+}
+
+uint8_t hidPollInterval(uint8_t devAddr, uint8_t instance)
+{
+    if (devAddr >= HID_MAX_DEVICES || instance >= HID_MAX_INSTANCES)
+        return 0;
+    return pollIntervals[devAddr][instance];
+}
+
+uint8_t hidPollDeviceInterval(uint8_t devAddr, uint8_t instance)
+{
+    if (devAddr >= HID_MAX_DEVICES || instance >= HID_MAX_INSTANCES)
+        return 0;
+    return deviceIntervals[devAddr][instance];
+}
@@ -0,0 +1,44 @@
+#ifndef _HID_POLL_H_
+#define _HID_POLL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hid_translate.h"
+
+// Polling interval overrides for HID interrupt IN endpoints. The host polls at the device's
+// bInterval, and plenty of keyboards ask for 8-10 ms, which is added to every key press before
+// the report even arrives. The configuration descriptor is patched during enumeration, before
+// TinyUSB opens the endpoints; a device that doesn't have anything new just NAKs the extra polls.
+//
+// Known devices get the interval from a VID:PID table (see hid_poll.c). For the others,
+// keyboard and mouse interfaces (boot protocol 1/2) are polled every HID_POLL_FAST_MS, anything
+// else (consumer control, vendor, gamepads) at most every HID_POLL_OTHER_MS so it doesn't take
+// bus time from them. Low speed devices are never polled faster than HID_POLL_LOW_SPEED_MS, the
+// minimum for their interrupt endpoints (USB 2.0, 5.7.4); plenty of them, and some hubs,
+// misbehave below it.
+
+#ifndef HID_POLL_OVERRIDE
+#define HID_POLL_OVERRIDE           1
+#endif
+
+#ifndef HID_POLL_FAST_MS
+#define HID_POLL_FAST_MS            1
+#endif
+
+#ifndef HID_POLL_OTHER_MS
+#define HID_POLL_OTHER_MS           4
+#endif
+
+#define HID_POLL_LOW_SPEED_MS       10
+
+// Lowers bInterval of the HID interrupt IN endpoints in 'desc' (a full configuration
+// descriptor) in place, and remembers the result per HID instance. Returns how many
+// endpoints were changed.
+uint32_t hidPollPatchConfig(uint8_t devAddr, uint16_t vid, uint16_t pid, bool lowSpeed, uint8_t* desc, uint16_t len);
+
+// Effective interval in ms, and the one the device asked for; 0 if not known
+uint8_t hidPollInterval(uint8_t devAddr, uint8_t instance);
+uint8_t hidPollDeviceInterval(uint8_t devAddr, uint8_t instance);
+
+#endif
@@ -0,0 +1,910 @@
+#include <string.h>
+
+#include "x68k_platform.h"
+#include "hid_parser.h"
+#include "hid_translate.h"
+#include "macro.h"
+
+// HID usages and bits used here, from the HID 1.11 Usage Tables
+#define HID_KEY_CONTROL_LEFT        0xe0
+#define HID_KEY_GUI_RIGHT           0xe7
+#define HID_ITF_PROTOCOL_NONE       0
+
+// Mouse report normalized from whatever layout the device uses
+typedef struct
+{
+    uint8_t buttons;
+    int16_t x;
+    int16_t y;
+    int8_t  wheel;
+} MouseReport;
+
+// Gamepad state: the directions from the hat switch or the left stick, then up to 16 buttons
+#define GAMEPAD_UP                  0x01
+#define GAMEPAD_DOWN                0x02
+#define GAMEPAD_LEFT                0x04
+#define GAMEPAD_RIGHT               0x08
+#define GAMEPAD_BUTTON_SHIFT        4
+
+// Stick motion is carried in 1/2^GAMEPAD_MOUSE_SHIFT counts, so whole counts are a shift away;
+// GAMEPAD_MOUSE_RATE is that per unit of deflection (-256..256) and us at GAMEPAD_MOUSE_SPEED
+#define GAMEPAD_MOUSE_SHIFT         26
+#define GAMEPAD_MOUSE_RATE          ((GAMEPAD_MOUSE_SPEED * (1ll << GAMEPAD_MOUSE_SHIFT) + 128000000) / 256000000)
+
+// Full deflection over the longest gap, on top of less than one count carried, in int32
+_Static_assert(256ll * GAMEPAD_MOUSE_MAX_GAP_US * GAMEPAD_MOUSE_RATE + (1ll << GAMEPAD_MOUSE_SHIFT) <= INT32_MAX,
+               "GAMEPAD_MOUSE_SPEED too high for GAMEPAD_MOUSE_SHIFT");
+
+// Keyboard state as one bit per HID usage; modifiers are usages 0xE0-0xE7
+#define KEYB_BITMAP_WORDS           (256 / 32)
+
+typedef struct
+{
+    uint32_t keys[KEYB_BITMAP_WORDS];
+} KeyBitmap;
+
+static inline void setKeyBit(KeyBitmap* bitmap, uint8_t keyCode)
+{
+    bitmap->keys[keyCode >> 5] |= 1u << (keyCode & 31);
+}
+
+static inline bool getKeyBit(KeyBitmap const* bitmap, uint8_t keyCode)
+{
+    return bitmap->keys[keyCode >> 5] & (1u << (keyCode & 31));
+}
+
+// Usages 0xE0-0xE7 (LEFTCTRL..RIGHTGUI) end up in the low byte of the last bitmap word
+#define KEYB_MODIFIER_WORD          (HID_KEY_CONTROL_LEFT >> 5)
+#define KEYB_MODIFIER_BITS          0x000000ff
+
+// Per-instance state: the field layout built from the report descriptor at mount time, and
+// what has been passed on to the X68000 side so far
+typedef struct
+{
+    HidLayout layout;
+    KeyBitmap keys;
+    KeyBitmap pending;          // newest keyboard report, waiting for event ring space
+    uint32_t pendingTimestamp;
+    bool hasPending;
+    uint8_t mouseButtons;
+
+    // Gamepad: directions and buttons as GAMEPAD_xxx bits, as sent and as last reported
+    uint32_t padSent;
+    uint32_t padWanted;
+    uint32_t padTimestamp;
+    bool padPending;
+    uint32_t padMouseTimestamp; // previous report, for the stick speed
+    int32_t padMouseX;          // stick motion not yet a whole count, see GAMEPAD_MOUSE_SHIFT
+    int32_t padMouseY;
+
+    // LED output: what was last sent (HID_LEDS_UNKNOWN before the first), and the report
+    // buffer, which has to stay put until the SET_REPORT is done
+    uint16_t ledsSent;
+    bool ledsInFlight;
+    uint8_t ledsFailures;
+    uint8_t ledReport[8];
+} HidInstance;
+
+#define HID_LEDS_UNKNOWN            0x100
+#define HID_LED_RETRIES             3       // then the keyboard is left alone until the next change
+
+static HidInstance hidInstances[HID_MAX_DEVICES][HID_MAX_INSTANCES];
+static uint8_t hidPendingCount      = 0;
+
+EventRing inputEvents;
+
+static uint8_t ledsWanted           = 0;
+static bool ledsDirty               = false;    // some keyboard may be out of date
+
+static uint8_t dumpChordModifiers   = HID_DUMP_CHORD_MODIFIERS;
+static uint8_t dumpChordKey         = HID_DUMP_CHORD_KEY;
+static bool dumpRequested           = false;
+
+// Mouse motion that didn't fit in the event ring, sent along with the next mouse event. A
+// pending mouse event (motion or a button change) is retried from flushHidReports().
+static int32_t mouseCarryX          = 0;
+static int32_t mouseCarryY          = 0;
+static bool mousePending            = false;
+static uint32_t mouseTimestamp      = 0;
+
+// Number of devices holding each X68000 key, so e.g. both SHIFTs (or the same key on two
+// keyboards) only make on the first press and break on the last release
+static uint8_t scanRefCount[0x80];
+
+static void processKeybReport(HidInstance* hid, KeyBitmap const *report, uint32_t timestamp);
+static void processMouseReport(HidInstance* hid, MouseReport const * report, uint32_t timestamp);
+static void processPadReport(HidInstance* hid, uint32_t state, uint32_t timestamp);
+static void sendMouseEvent(uint32_t timestamp);
+
+static HidInstance* getHidInstance(uint8_t devAddr, uint8_t instance)
+{
+    if (devAddr >= HID_MAX_DEVICES || instance >= HID_MAX_INSTANCES)
+        return NULL;
+    return &hidInstances[devAddr][instance];
+}
+
+static bool pushInputEvent(InputEvent const* event)
+{
+    if (!eventRingPush(&inputEvents, event))
+        return false;
+
+    platformWakeConsumer();
+    return true;
+}
+
+bool hidReportsPending(void)
+{
+    return hidPendingCount || eventRingCount(&inputEvents);
+}
+
+void flushHidReports(void)
+{
+    if (!hidPendingCount)
+        return;
+
+    if (mousePending)
+        sendMouseEvent(mouseTimestamp);
+
+    for (int d = 0; d < HID_MAX_DEVICES; ++d)
+    {
+        for (int i = 0; i < HID_MAX_INSTANCES; ++i)
+        {
+            HidInstance* hid = &hidInstances[d][i];
+            if (hid->hasPending)
+                processKeybReport(hid, &hid->pending, hid->pendingTimestamp);
+            if (hid->padPending)
+                processPadReport(hid, hid->padWanted, hid->padTimestamp);
+        }
+    }
+}
+
+// Returns false for reports that must be ignored (ErrorRollOver)
+static bool decodeKeybReport(HidKeybLayout const* layout, uint8_t const* report, uint16_t len, KeyBitmap* out)
+{
+    memset(out, 0, sizeof(*out));
+
+    if (layout->modifiers.bitSize)
+        out->keys[HID_KEY_CONTROL_LEFT >> 5] |= hidGetField(report, len, &layout->modifiers);
+
+    if (layout->keys.bitSize)
+    {
+        HidField key = layout->keys;
+        for (int i = 0; i < layout->keyCount; ++i, key.bitOffset += key.bitSize)
+        {
+            uint32_t keyCode = hidGetField(report, len, &key);
+            if (keyCode == 0x01)
+                return false;
+            if (keyCode > 0x03 && keyCode <= HID_KEY_GUI_RIGHT)
+                setKeyBit(out, keyCode);
+        }
+    }
+
+    // NKRO bitmaps are copied 8 usages at a time (the parser keeps them below 0xE0)
+    if (layout->keyBitmap.bitSize)
+    {
+        for (uint32_t i = 0; i < layout->keyBitmapCount; i += 8)
+        {
+            uint32_t count = layout->keyBitmapCount - i;
+            HidField chunk = { layout->keyBitmap.bitOffset + i, count < 8 ? count : 8, false };
+            uint32_t bits = hidGetField(report, len, &chunk);
+            if (!bits)
+                continue;
+
+            uint32_t usage = layout->keyBitmapMin + i;
+            out->keys[usage >> 5] |= bits << (usage & 31);
+            if ((usage & 31) > 24)
+                out->keys[(usage >> 5) + 1] |= bits >> (32 - (usage & 31));
+        }
+
+        // Skip ErrorRollOver, POSTFail & ErrorUndefined
+        out->keys[0] &= ~0x0fu;
+    }
+
+    return true;
+}
+
+static int16_t clampInt16(int32_t value)
+{
+    return value > INT16_MAX ? INT16_MAX : value < INT16_MIN ? INT16_MIN : value;
+}
+
+static void decodeMouseReport(HidMouseLayout const* layout, uint8_t const* report, uint16_t len, MouseReport* out)
+{
+    out->buttons = layout->buttons.bitSize ? hidGetField(report, len, &layout->buttons) : 0;
+    out->x = clampInt16(hidGetField(report, len, &layout->x));
+    out->y = clampInt16(hidGetField(report, len, &layout->y));
+    out->wheel = layout->wheel.bitSize ? hidGetField(report, len, &layout->wheel) : 0;
+}
+
+// Deflection from the center as -256..256, 0 for an axis that isn't there. The parser only
+// takes axes of up to 16 bits, so this can't overflow.
+static int32_t getAxis(uint8_t const* report, uint16_t len, HidAxis const* axis)
+{
+    if (!axis->half)
+        return 0;
+
+    int32_t value = ((hidGetField(report, len, &axis->field) - axis->center) * 256) / axis->half;
+    return value > 256 ? 256 : value < -256 ? -256 : value;
+}
+
+static uint32_t decodePadReport(HidGamepadLayout const* layout, uint8_t const* report, uint16_t len)
+{
+    // Up, right, down, left: clockwise from up like the hat switch
+    static uint8_t const hatDirections[8] =
+    {
+        GAMEPAD_UP, GAMEPAD_UP | GAMEPAD_RIGHT, GAMEPAD_RIGHT, GAMEPAD_DOWN | GAMEPAD_RIGHT,
+        GAMEPAD_DOWN, GAMEPAD_DOWN | GAMEPAD_LEFT, GAMEPAD_LEFT, GAMEPAD_UP | GAMEPAD_LEFT,
+    };
+
+    uint32_t state = 0;
+    if (layout->buttons.bitSize)
+        state = (uint32_t)hidGetField(report, len, &layout->buttons) << GAMEPAD_BUTTON_SHIFT;
+
+    if (layout->hat.bitSize)
+    {
+        uint32_t hat = hidGetField(report, len, &layout->hat) - layout->hatMin;
+        if (hat < 8)
+            state |= hatDirections[hat];
+    }
+
+    // The left stick is digital, past half way
+    int32_t x = getAxis(report, len, &layout->x);
+    int32_t y = getAxis(report, len, &layout->y);
+    state |= x < -128 ? GAMEPAD_LEFT : x > 128 ? GAMEPAD_RIGHT : 0;
+    state |= y < -128 ? GAMEPAD_UP : y > 128 ? GAMEPAD_DOWN : 0;
+    return state;
+}
+
+// %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+//
+// HID to X68000 translation
+//
+
+// HID usage -> X68000 scancode for every keyboard page usage, 0x00 = no key. The remaining
+// X68000-only keys (OPT.1/2, SYMBOL INPUT, TOROKU, CODE INPUT) sit on keys a PC keyboard has
+// spare. Kept in scratch RAM, it's read for every changed key; hidLoadConfig() can change it.
+static uint8_t keyScans[256] PLATFORM_SCRATCH_X("keyScans") =
+{
+    [0x04] = 0x1e,    // "A"           = HID_KEY_A
+    [0x05] = 0x2e,    // "B"           = HID_KEY_B
+    [0x06] = 0x2c,    // "C"           = HID_KEY_C
+    [0x07] = 0x20,    // "D"           = HID_KEY_D
+    [0x08] = 0x13,    // "E"           = HID_KEY_E
+    [0x09] = 0x21,    // "F"           = HID_KEY_F
+    [0x0a] = 0x22,    // "G"           = HID_KEY_G
+    [0x0b] = 0x23,    // "H"           = HID_KEY_H
+    [0x0c] = 0x18,    // "I"           = HID_KEY_I
+    [0x0d] = 0x24,    // "J"           = HID_KEY_J
+    [0x0e] = 0x25,    // "K"           = HID_KEY_K
+    [0x0f] = 0x26,    // "L"           = HID_KEY_L
+    [0x10] = 0x30,    // "M"           = HID_KEY_M
+    [0x11] = 0x2f,    // "N"           = HID_KEY_N
+    [0x12] = 0x19,    // "O"           = HID_KEY_O
+    [0x13] = 0x1a,    // "P"           = HID_KEY_P
+    [0x14] = 0x11,    // "Q"           = HID_KEY_Q
+    [0x15] = 0x14,    // "R"           = HID_KEY_R
+    [0x16] = 0x1f,    // "S"           = HID_KEY_S
+    [0x17] = 0x15,    // "T"           = HID_KEY_T
+    [0x18] = 0x17,    // "U"           = HID_KEY_U
+    [0x19] = 0x2d,    // "V"           = HID_KEY_V
+    [0x1a] = 0x12,    // "W"           = HID_KEY_W
+    [0x1b] = 0x2b,    // "X"           = HID_KEY_X
+    [0x1c] = 0x16,    // "Y"           = HID_KEY_Y
+    [0x1d] = 0x2a,    // "Z"           = HID_KEY_Z
+    [0x1e] = 0x02,    // "1"           = HID_KEY_1
+    [0x1f] = 0x03,    // "2"           = HID_KEY_2
+    [0x20] = 0x04,    // "3"           = HID_KEY_3
+    [0x21] = 0x05,    // "4"           = HID_KEY_4
+    [0x22] = 0x06,    // "5"           = HID_KEY_5
+    [0x23] = 0x07,    // "6"           = HID_KEY_6
+    [0x24] = 0x08,    // "7"           = HID_KEY_7
+    [0x25] = 0x09,    // "8"           = HID_KEY_8
+    [0x26] = 0x0a,    // "9"           = HID_KEY_9
+    [0x27] = 0x0b,    // "0"           = HID_KEY_0
+    [0x28] = 0x1d,    // "RETURN"      = HID_KEY_ENTER
+    [0x29] = 0x01,    // "ESC"         = HID_KEY_ESCAPE
+    [0x2a] = 0x0f,    // "BS"          = HID_KEY_BACKSPACE
+    [0x2b] = 0x10,    // "TAB"         = HID_KEY_TAB
+    [0x2c] = 0x35,    // "SPACE"       = HID_KEY_SPACE
+    [0x2d] = 0x0c,    // "-"           = HID_KEY_MINUS
+    [0x2e] = 0x0d,    // "^"           = HID_KEY_EQUAL
+    [0x2f] = 0x1b,    // "@"           = HID_KEY_BRACKET_LEFT
+    [0x30] = 0x1c,    // "["           = HID_KEY_BRACKET_RIGHT
+    [0x31] = 0x0e,    // "YEN"         = HID_KEY_BACKSLASH
+    [0x32] = 0x29,    // "]"           = HID_KEY_EUROPE_1
+    [0x33] = 0x27,    // ";"           = HID_KEY_SEMICOLON
+    [0x34] = 0x28,    // ":"           = HID_KEY_APOSTROPHE
+    [0x35] = 0x60,    // "ZENKAKU"     = HID_KEY_GRAVE
+    [0x36] = 0x31,    // < ,           = HID_KEY_COMMA
+    [0x37] = 0x32,    // > .           = HID_KEY_PERIOD
+    [0x38] = 0x33,    // ? /           = HID_KEY_SLASH
+    [0x39] = 0x5d,    // "CAPS"        = HID_KEY_CAPS_LOCK
+    [0x3a] = 0x63,    // "F1"          = HID_KEY_F1
+    [0x3b] = 0x64,    // "F2"          = HID_KEY_F2
+    [0x3c] = 0x65,    // "F3"          = HID_KEY_F3
+    [0x3d] = 0x66,    // "F4"          = HID_KEY_F4
+    [0x3e] = 0x67,    // "F5"          = HID_KEY_F5
+    [0x3f] = 0x68,    // "F6"          = HID_KEY_F6
+    [0x40] = 0x69,    // "F7"          = HID_KEY_F7
+    [0x41] = 0x6a,    // "F8"          = HID_KEY_F8
+    [0x42] = 0x6b,    // "F9"          = HID_KEY_F9
+    [0x43] = 0x6c,    // "F10"         = HID_KEY_F10
+#if X68K_LAYOUT == X68K_LAYOUT_OPT_KEYS
+    [0x44] = 0x72,    // "OPT.1"       = HID_KEY_F11
+    [0x45] = 0x73,    // "OPT.2"       = HID_KEY_F12
+#else
+    [0x44] = 0x5a,    // "KANA"        = HID_KEY_F11
+    [0x45] = 0x5b,    // "LATIN"       = HID_KEY_F12
+#endif
+    [0x46] = 0x62,    // "COPY"        = HID_KEY_PRINT_SCREEN
+    [0x47] = 0x54,    // "HELP"        = HID_KEY_SCROLL_LOCK
+    [0x48] = 0x61,    // "BREAK"       = HID_KEY_PAUSE
+    [0x49] = 0x5e,    // "INS"         = HID_KEY_INSERT
+    [0x4a] = 0x36,    // "HOME"        = HID_KEY_HOME
+    [0x4b] = 0x38,    // "ROLL UP"     = HID_KEY_PAGE_UP
+    [0x4c] = 0x37,    // "DEL"         = HID_KEY_DELETE
+    [0x4d] = 0x3a,    // "UNDO"        = HID_KEY_END
+    [0x4e] = 0x39,    // "ROLL DOWN"   = HID_KEY_PAGE_DOWN
+    [0x4f] = 0x3d,    // "RIGHT"       = HID_KEY_ARROW_RIGHT
+    [0x50] = 0x3b,    // "LEFT"        = HID_KEY_ARROW_LEFT
+    [0x51] = 0x3e,    // "DOWN"        = HID_KEY_ARROW_DOWN
+    [0x52] = 0x3c,    // "UP"          = HID_KEY_ARROW_UP
+    [0x53] = 0x3f,    // "CLR"         = HID_KEY_NUM_LOCK
+    [0x54] = 0x40,    // "/"           = HID_KEY_KEYPAD_DIVIDE
+    [0x55] = 0x41,    // "*"           = HID_KEY_KEYPAD_MULTIPLY
+    [0x56] = 0x42,    // "-"           = HID_KEY_KEYPAD_SUBTRACT
+    [0x57] = 0x46,    // "+"           = HID_KEY_KEYPAD_ADD
+    [0x58] = 0x4e,    // "ENTER"       = HID_KEY_KEYPAD_ENTER
+    [0x59] = 0x4b,    // "1"           = HID_KEY_KEYPAD_1
+    [0x5a] = 0x4c,    // "2"           = HID_KEY_KEYPAD_2
+    [0x5b] = 0x4d,    // "3"           = HID_KEY_KEYPAD_3
+    [0x5c] = 0x47,    // "4"           = HID_KEY_KEYPAD_4
+    [0x5d] = 0x48,    // "5"           = HID_KEY_KEYPAD_5
+    [0x5e] = 0x49,    // "6"           = HID_KEY_KEYPAD_6
+    [0x5f] = 0x43,    // "7"           = HID_KEY_KEYPAD_7
+    [0x60] = 0x44,    // "8"           = HID_KEY_KEYPAD_8
+    [0x61] = 0x45,    // "9"           = HID_KEY_KEYPAD_9
+    [0x62] = 0x4f,    // "0"           = HID_KEY_KEYPAD_0
+    [0x63] = 0x51,    // "."           = HID_KEY_KEYPAD_DECIMAL
+    [0x64] = 0x0e,    // "YEN"         = HID_KEY_EUROPE_2
+
+    // Keypad extras, International and LANG keys (JIS/ISO/Korean keyboards)
+    [0x65] = 0x72,    // "OPT.1"       = HID_KEY_APPLICATION
+    [0x67] = 0x4a,    // "="           = HID_KEY_KEYPAD_EQUAL
+    [0x68] = 0x52,    // "SYMBOL INPUT" = HID_KEY_F13
+    [0x69] = 0x53,    // "TOROKU"      = HID_KEY_F14
+    [0x6a] = 0x5c,    // "CODE INPUT"  = HID_KEY_F15
+    [0x6b] = 0x72,    // "OPT.1"       = HID_KEY_F16
+    [0x6c] = 0x73,    // "OPT.2"       = HID_KEY_F17
+    [0x75] = 0x54,    // "HELP"        = HID_KEY_HELP
+    [0x7a] = 0x3a,    // "UNDO"        = HID_KEY_UNDO
+    [0x7c] = 0x62,    // "COPY"        = HID_KEY_COPY
+    [0x85] = 0x50,    // ","           = HID_KEY_KEYPAD_COMMA
+    [0x86] = 0x4a,    // "="           = HID_KEY_KEYPAD_EQUAL_SIGN
+    [0x87] = 0x34,    // "_"           = HID_KEY_KANJI1   (International1, Ro)
+    [0x88] = 0x5f,    // "HIRAGANA"    = HID_KEY_KANJI2   (International2, Katakana/Hiragana)
+    [0x89] = 0x0e,    // "YEN"         = HID_KEY_KANJI3   (International3)
+    [0x8a] = 0x57,    // "XF3"         = HID_KEY_KANJI4   (International4, Henkan)
+    [0x8b] = 0x56,    // "XF2"         = HID_KEY_KANJI5   (International5, Muhenkan)
+    [0x90] = 0x5a,    // "KANA"        = HID_KEY_LANG1
+    [0x91] = 0x5b,    // "LATIN"       = HID_KEY_LANG2
+    [0x92] = 0x5a,    // "KANA"        = HID_KEY_LANG3   (Katakana)
+    [0x93] = 0x5f,    // "HIRAGANA"    = HID_KEY_LANG4
+    [0x94] = 0x60,    // "ZENKAKU"     = HID_KEY_LANG5
+
+    // Modifiers, LEFTCTRL..RIGHTGUI
+    [0xe0] = 0x71,    // "CTRL"        = HID_KEY_CONTROL_LEFT
+    [0xe1] = 0x70,    // "SHIFT"       = HID_KEY_SHIFT_LEFT
+    [0xe2] = 0x56,    // "XF2"         = HID_KEY_ALT_LEFT
+    [0xe3] = 0x55,    // "XF1"         = HID_KEY_GUI_LEFT
+    [0xe4] = 0x59,    // "XF5"         = HID_KEY_CONTROL_RIGHT
+    [0xe5] = 0x70,    // "SHIFT"       = HID_KEY_SHIFT_RIGHT
+    [0xe6] = 0x57,    // "XF3"         = HID_KEY_ALT_RIGHT
+    [0xe7] = 0x58,    // "XF4"         = HID_KEY_GUI_RIGHT
+};
+
+// Queues a make/break event for one X68000 key, unless another key or device is still
+// holding it. Returns true if an event was queued.
+static bool pushKeyEvent(uint8_t scan, bool make, uint8_t flags, uint32_t timestamp)
+{
+    if (make)
+    {
+        if (scanRefCount[scan]++)
+            return false;
+    }
+    else
+    {
+        if (!scanRefCount[scan] || --scanRefCount[scan])
+            return false;
+    }
+
+    InputEvent event =
+    {
+        .timestamp = timestamp,
+        .type = EVENT_KEY,
+        .flags = flags,
+        .scan = scan | (make ? 0x00 : 0x80),
+    };
+    return pushInputEvent(&event);
+}
+
+static bool pushMacroEvent(uint8_t macro, bool make, uint32_t timestamp)
+{
+    InputEvent event =
+    {
+        .timestamp = timestamp,
+        .type = EVENT_MACRO,
+        .scan = macro | (make ? 0x00 : 0x80),
+    };
+    return pushInputEvent(&event);
+}
+
+// A key bound to a macro starts and stops that instead of sending its own scancode
+static void pushUsageEvent(uint8_t usage, bool make, uint8_t flags, uint32_t timestamp)
+{
+    uint8_t macro = macroFind(usage);
+    if (macro != MACRO_NONE)
+        pushMacroEvent(macro, make, timestamp);
+    else if (keyScans[usage])
+        pushKeyEvent(keyScans[usage], make, flags, timestamp);
+}
+
+// Upper bound for the number of scancodes the set bits in 'changed' turn into
+static uint32_t countKeybChanges(KeyBitmap const* changed)
+{
+    uint32_t count = __builtin_popcount(changed->keys[KEYB_MODIFIER_WORD] & KEYB_MODIFIER_BITS);
+
+    for (int w = 0; w < KEYB_BITMAP_WORDS; ++w)
+    {
+        uint32_t bits = changed->keys[w];
+        if (w == KEYB_MODIFIER_WORD)
+            bits &= ~KEYB_MODIFIER_BITS;
+
+        while (bits)
+        {
+            uint32_t bit = 31 - __builtin_clz(bits);
+            bits &= ~(1u << bit);
+            count += keyScans[(w << 5) | bit] != 0 || macroFind((w << 5) | bit) != MACRO_NONE;
+        }
+    }
+    return count;
+}
+
+// Emits BREAKs (make = false) or MAKEs (make = true) for the changed non-modifier keys
+static void sendKeybChanges(KeyBitmap const* changed, KeyBitmap const* current, bool make, uint32_t timestamp)
+{
+    for (int w = 0; w < KEYB_BITMAP_WORDS; ++w)
+    {
+        uint32_t bits = changed->keys[w] & (make ? current->keys[w] : ~current->keys[w]);
+        if (w == KEYB_MODIFIER_WORD)
+            bits &= ~KEYB_MODIFIER_BITS;
+
+        while (bits)
+        {
+            uint32_t bit = 31 - __builtin_clz(bits);
+            bits &= ~(1u << bit);
+
+            pushUsageEvent((w << 5) | bit, make, EVENT_FLAG_REPEAT, timestamp);
+        }
+    }
+}
+
+static void processKeybReport(HidInstance* hid, KeyBitmap const *report, uint32_t timestamp)
+{
+    KeyBitmap changed;
+    for (int w = 0; w < KEYB_BITMAP_WORDS; ++w)
+        changed.keys[w] = hid->keys.keys[w] ^ report->keys[w];
+
+    // Backpressure: if the whole delta doesn't fit in the event ring, hold on to the report
+    // (newer reports simply replace it) and retry from flushHidReports()
+    uint32_t needed = countKeybChanges(&changed);
+    if (needed > eventRingFree(&inputEvents))
+    {
+        if (!hid->hasPending)
+            ++hidPendingCount;
+        if (report != &hid->pending)
+            hid->pending = *report;
+        hid->pendingTimestamp = timestamp;
+        hid->hasPending = true;
+        if (report != &hid->pending)
+            ++inputEvents.keyOverflows;
+        return;
+    }
+    if (hid->hasPending)
+        --hidPendingCount;
+    hid->hasPending = false;
+
+    // The chord key going down with (at least) the chord modifiers held, left or right
+    uint8_t held = report->keys[KEYB_MODIFIER_WORD] & KEYB_MODIFIER_BITS;
+    held = (held | held >> 4) & 0x0f;
+    if (getKeyBit(&changed, dumpChordKey) && getKeyBit(report, dumpChordKey) &&
+        (held & dumpChordModifiers) == dumpChordModifiers)
+        dumpRequested = true;
+
+    // Evaluate modifiers (SHIFT/CTRL/ALT/GUI)
+    uint8_t modified = changed.keys[KEYB_MODIFIER_WORD] & KEYB_MODIFIER_BITS;
+    if (modified)
+    {
+        uint8_t modifiers = report->keys[KEYB_MODIFIER_WORD] & KEYB_MODIFIER_BITS;
+        for (int i = 0; i < 8; ++i)
+        {
+            // Like other keys, a modifier remapped to 0 sends nothing
+            uint8_t mod = 1 << i;
+            uint8_t scan = keyScans[HID_KEY_CONTROL_LEFT + i];
+            if ((modified & mod) && scan)
+                pushKeyEvent(scan, modifiers & mod, 0, timestamp);
+        }
+    }
+
+    // evaluate BREAK codes (key-up)
+    sendKeybChanges(&changed, report, false, timestamp);
+
+    // evaluate MAKE codes (key-down)
+    sendKeybChanges(&changed, report, true, timestamp);
+
+    hid->keys = *report;
+}
+
+// HID keyboard usages for the gamepad state bits, looked up through keyScans[] and the macros
+// like keyboard keys: the numeric keypad arrows, then the buttons. A 0 leaves the bit unmapped.
+static uint8_t const gamepadKeys[32] =
+{
+    [0]  = 0x60,    // UP               = HID_KEY_KEYPAD_8
+    [1]  = 0x5a,    // DOWN             = HID_KEY_KEYPAD_2
+    [2]  = 0x5c,    // LEFT             = HID_KEY_KEYPAD_4
+    [3]  = 0x5e,    // RIGHT            = HID_KEY_KEYPAD_6
+    [4]  = 0x1d,    // button 1         = HID_KEY_Z
+    [5]  = 0x1b,    // button 2         = HID_KEY_X
+    [6]  = 0x06,    // button 3         = HID_KEY_C
+    [7]  = 0x04,    // button 4         = HID_KEY_A
+    [8]  = 0x16,    // button 5         = HID_KEY_S
+    [9]  = 0x07,    // button 6         = HID_KEY_D
+    [10] = 0x14,    // button 7         = HID_KEY_Q
+    [11] = 0x1a,    // button 8         = HID_KEY_W
+    [12] = 0x29,    // button 9 (select) = HID_KEY_ESCAPE
+    [13] = 0x28,    // button 10 (start) = HID_KEY_ENTER
+    [14] = 0x2c,    // button 11        = HID_KEY_SPACE
+    [15] = 0x2b,    // button 12        = HID_KEY_TAB
+};
+
+// Emits BREAKs (make = false) or MAKEs (make = true) for the changed gamepad bits. Pads
+// don't auto-repeat; games read the key state, and repeats would only crowd the line.
+static void sendPadChanges(uint32_t bits, bool make, uint32_t timestamp)
+{
+    while (bits)
+    {
+        uint32_t bit = __builtin_ctz(bits);
+        bits &= bits - 1;
+
+        if (gamepadKeys[bit])
+            pushUsageEvent(gamepadKeys[bit], make, 0, timestamp);
+    }
+}
+
+// A pad reporting at 1000 Hz mostly repeats itself, so the common case is one compare
+static void processPadReport(HidInstance* hid, uint32_t state, uint32_t timestamp)
+{
+    uint32_t changed = state ^ hid->padSent;
+    if (!changed)
+    {
+        if (hid->padPending)
+            --hidPendingCount;
+        hid->padPending = false;
+        return;
+    }
+
+    // Like keyboard reports, held back until the whole delta fits
+    if ((uint32_t)__builtin_popcount(changed) > eventRingFree(&inputEvents))
+    {
+        if (!hid->padPending)
+        {
+            ++hidPendingCount;
+            ++inputEvents.keyOverflows;
+        }
+        hid->padWanted = state;
+        hid->padTimestamp = timestamp;
+        hid->padPending = true;
+        return;
+    }
+    if (hid->padPending)
+        --hidPendingCount;
+    hid->padPending = false;
+
+    sendPadChanges(changed & ~state, false, timestamp);
+    sendPadChanges(changed & state, true, timestamp);
+    hid->padSent = state;
+}
+
+// Rounded towards zero either way, so the fraction left over never carries a bias
+static int32_t takeWholeCounts(int32_t* motion)
+{
+    int32_t counts = *motion >= 0 ? *motion >> GAMEPAD_MOUSE_SHIFT : -(-*motion >> GAMEPAD_MOUSE_SHIFT);
+    *motion -= counts * (1 << GAMEPAD_MOUSE_SHIFT);
+    return counts;
+}
+
+// The right stick moves the mouse at up to GAMEPAD_MOUSE_SPEED counts/s, whatever the report rate
+static bool decodePadMouse(HidInstance* hid, uint8_t const* report, uint16_t len, uint32_t timestamp, MouseReport* out)
+{
+    HidGamepadLayout const* layout = &hid->layout.pad;
+    uint32_t elapsed = timestamp - hid->padMouseTimestamp;
+    hid->padMouseTimestamp = timestamp;
+
+    if (!layout->rx.half || !layout->ry.half)
+        return false;
+
+    if (elapsed > GAMEPAD_MOUSE_MAX_GAP_US)
+        elapsed = GAMEPAD_MOUSE_MAX_GAP_US;
+
+    int32_t x = getAxis(report, len, &layout->rx);
+    int32_t y = getAxis(report, len, &layout->ry);
+    if (x > -GAMEPAD_DEADZONE && x < GAMEPAD_DEADZONE)
+        x = 0;
+    if (y > -GAMEPAD_DEADZONE && y < GAMEPAD_DEADZONE)
+        y = 0;
+
+    hid->padMouseX += x * (int32_t)elapsed * (int32_t)GAMEPAD_MOUSE_RATE;
+    hid->padMouseY += y * (int32_t)elapsed * (int32_t)GAMEPAD_MOUSE_RATE;
+
+    out->buttons = hid->mouseButtons;
+    out->x = takeWholeCounts(&hid->padMouseX);
+    out->y = takeWholeCounts(&hid->padMouseY);
+    out->wheel = 0;
+    return out->x || out->y;
+}
+
+// Sends the merged buttons and the motion carried so far. Whatever doesn't go out (a full ring,
+// or more motion than one event holds) stays pending until it does.
+static void sendMouseEvent(uint32_t timestamp)
+{
+    // Buttons are held if any mouse holds them, motion simply adds up
+    uint8_t buttons = 0;
+    for (int d = 0; d < HID_MAX_DEVICES; ++d)
+    {
+        for (int i = 0; i < HID_MAX_INSTANCES; ++i)
+            buttons |= hidInstances[d][i].mouseButtons;
+    }
+
+    InputEvent event =
+    {
+        .timestamp = timestamp,
+        .type = EVENT_MOUSE,
+        .buttons = buttons,
+        .dx = clampInt16(mouseCarryX),
+        .dy = clampInt16(mouseCarryY),
+    };
+
+    bool sent = pushInputEvent(&event);
+    if (sent)
+    {
+        mouseCarryX -= event.dx;
+        mouseCarryY -= event.dy;
+    }
+    else if (!mousePending)
+    {
+        ++inputEvents.mouseOverflows;
+    }
+
+    bool pending = !sent || mouseCarryX || mouseCarryY;
+    if (pending != mousePending)
+        hidPendingCount += pending ? 1 : -1;
+    mousePending = pending;
+    mouseTimestamp = timestamp;
+}
+
+static void processMouseReport(HidInstance* hid, MouseReport const * report, uint32_t timestamp)
+{
+    hid->mouseButtons = report->buttons;
+    mouseCarryX += report->x;
+    mouseCarryY += report->y;
+
+    // A pending event keeps its timestamp, the oldest input it carries
+    sendMouseEvent(mousePending ? mouseTimestamp : timestamp);
+}
+
+// %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+//
+// Mount, unmount and report entry points (called from the TinyUSB callbacks)
+//
+
+bool hidMount(uint8_t devAddr, uint8_t instance, uint8_t itfProtocol, uint8_t const* desc, uint16_t descLen)
+{
+    HidInstance* hid = getHidInstance(devAddr, instance);
+    if (!hid)
+        return false;
+
+    // Keys still held from a previous device at this address are released by the first report
+    hid->mouseButtons = 0;
+    hid->padMouseX = 0;
+    hid->padMouseY = 0;
+
+    // Gets the current LEDs once it's up
+    hid->ledsSent = HID_LEDS_UNKNOWN;
+    hid->ledsInFlight = false;
+    hid->ledsFailures = 0;
+    ledsDirty = true;
+
+    if (!hidParseReportDescriptor(desc, descLen, &hid->layout) && itfProtocol != HID_ITF_PROTOCOL_NONE)
+    {
+        hidBootLayout(itfProtocol, &hid->layout);
+        return true;
+    }
+    return false;
+}
+
+void hidUnmount(uint8_t devAddr, uint8_t instance, uint32_t timestamp)
+{
+    HidInstance* hid = getHidInstance(devAddr, instance);
+    if (!hid)
+        return;
+
+    // Release whatever the device was holding down
+    if (hid->layout.flags & HID_LAYOUT_KEYBOARD)
+    {
+        KeyBitmap released = { {0} };
+        processKeybReport(hid, &released, timestamp);
+    }
+    if (hid->layout.flags & HID_LAYOUT_MOUSE)
+    {
+        MouseReport released = { 0 };
+        processMouseReport(hid, &released, timestamp);
+    }
+    if (hid->layout.flags & HID_LAYOUT_GAMEPAD)
+        processPadReport(hid, 0, timestamp);
+
+    // A release that is still pending keeps the instance around until it's been sent
+    hid->layout.flags = 0;
+}
+
+void hidReport(uint8_t devAddr, uint8_t instance, uint8_t const* report, uint16_t len, uint32_t timestamp)
+{
+    HidInstance* hid = getHidInstance(devAddr, instance);
+
+    if (!hid)
+    {
+        // not one of ours
+    }
+    else if ((hid->layout.flags & HID_LAYOUT_KEYBOARD) && hidLayoutMatches(hid->layout.keyb.reportId, report, len))
+    {
+        KeyBitmap keys;
+
+        // Flush any older keyboard reports first so they stay in order
+        flushHidReports();
+
+        if (decodeKeybReport(&hid->layout.keyb, report, len, &keys))
+            processKeybReport(hid, &keys, timestamp);
+    }
+    else if ((hid->layout.flags & HID_LAYOUT_MOUSE) && hidLayoutMatches(hid->layout.mouse.reportId, report, len))
+    {
+        MouseReport mouse;
+        decodeMouseReport(&hid->layout.mouse, report, len, &mouse);
+        processMouseReport(hid, &mouse, timestamp);
+    }
+    else if ((hid->layout.flags & HID_LAYOUT_GAMEPAD) && hidLayoutMatches(hid->layout.pad.reportId, report, len))
+    {
+        MouseReport mouse;
+        if (decodePadMouse(hid, report, len, timestamp, &mouse))
+            processMouseReport(hid, &mouse, timestamp);
+
+        processPadReport(hid, decodePadReport(&hid->layout.pad, report, len), timestamp);
+    }
+}
+
+void hidLoadConfig(X68kConfig const* config)
+{
+    uint32_t count = config->keyRemapCount;
+    if (count > CONFIG_KEY_REMAPS)
+        count = CONFIG_KEY_REMAPS;
+
+    // Scancodes are 7 bit, bit 7 is BREAK
+    for (uint32_t i = 0; i < count; ++i)
+        keyScans[config->keyRemaps[i].usage] = config->keyRemaps[i].scan & 0x7f;
+
+    if (config->dumpChordKey)
+    {
+        dumpChordModifiers = config->dumpChordModifiers & 0x0f;
+        dumpChordKey = config->dumpChordKey;
+    }
+}
+
+bool hidTakeDumpRequest(void)
+{
+    bool requested = dumpRequested;
+    dumpRequested = false;
+    return requested;
+}
+
+// %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+//
+// Keyboard LEDs
+//
+
+void hidSetLeds(uint8_t leds)
+{
+    if (leds == ledsWanted)
+        return;
+
+    ledsWanted = leds;
+    ledsDirty = true;
+
+    for (int d = 0; d < HID_MAX_DEVICES; ++d)
+    {
+        for (int i = 0; i < HID_MAX_INSTANCES; ++i)
+            hidInstances[d][i].ledsFailures = 0;
+    }
+}
+
+static uint16_t buildLedReport(HidKeybLayout const* keyb, uint8_t leds, uint8_t* report)
+{
+    memset(report, 0, keyb->ledReportLen);
+    if (keyb->ledReportId)
+        report[0] = keyb->ledReportId;
+
+    for (uint32_t i = 0; i < keyb->leds.bitSize; ++i)
+    {
+        uint32_t usage = keyb->ledUsageMin + i;
+        if (usage >= 1 && usage <= 8 && (leds & (1u << (usage - 1))))
+        {
+            uint32_t bit = keyb->leds.bitOffset + i;
+            report[bit >> 3] |= 1u << (bit & 7);
+        }
+    }
+    return keyb->ledReportLen;
+}
+
+bool hidNextLedReport(uint8_t* devAddr, uint8_t* instance, uint8_t* reportId, uint8_t const** report, uint16_t* len)
+{
+    if (!ledsDirty)
+        return false;
+
+    for (int d = 0; d < HID_MAX_DEVICES; ++d)
+    {
+        for (int i = 0; i < HID_MAX_INSTANCES; ++i)
+        {
+            HidInstance* hid = &hidInstances[d][i];
+            if (!(hid->layout.flags & HID_LAYOUT_KEYBOARD) || !hid->layout.keyb.ledReportLen ||
+                hid->ledsInFlight || hid->ledsSent == ledsWanted)
+                continue;
+
+            // Whatever changes while this one is out is sent after it, as one report
+            hid->ledsSent = ledsWanted;
+            hid->ledsInFlight = true;
+
+            *devAddr = d;
+            *instance = i;
+            *reportId = hid->layout.keyb.ledReportId;
+            *report = hid->ledReport;
+            *len = buildLedReport(&hid->layout.keyb, ledsWanted, hid->ledReport);
+            return true;
+        }
+    }
+
+    // Everything is either up to date, or gets another look from hidLedsDone()
+    ledsDirty = false;
+    return false;
+}
+
+void hidLedsDone(uint8_t devAddr, uint8_t instance, bool ok)
+{
+    HidInstance* hid = getHidInstance(devAddr, instance);
+    if (!hid || !hid->ledsInFlight)
+        return;
+
+    hid->ledsInFlight = false;
+    if (ok)
+        hid->ledsFailures = 0;
+    else if (++hid->ledsFailures < HID_LED_RETRIES)
+        hid->ledsSent = HID_LEDS_UNKNOWN;
+    ledsDirty = true;
+}
+
+void hidLedsNotStarted(uint8_t devAddr, uint8_t instance)
+{
+    HidInstance* hid = getHidInstance(devAddr, instance);
+    if (!hid || !hid->ledsInFlight)
+        return;
+
+    hid->ledsInFlight = false;
+    hid->ledsSent = HID_LEDS_UNKNOWN;
+    ledsDirty = true;
+}
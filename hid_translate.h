@@ -0,0 +1,94 @@
+#ifndef _HID_TRANSLATE_H_
+#define _HID_TRANSLATE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "tusb_config.h"
+#include "event_ring.h"
+#include "config.h"
+
+// USB side: turns HID reports into X68000 key and mouse events. Keeps per-instance state so
+// several keyboards/mice can be used at once, and merges them (a key held on any keyboard is
+// held). No pico-sdk or TinyUSB calls, so this also builds for the host (see host/).
+
+// Keyboard layout variant: F11/F12 as KANA/LATIN (X68K_LAYOUT_DEFAULT), or as OPT.1/OPT.2
+// (X68K_LAYOUT_OPT_KEYS). The other X68000-only keys are on F13-F17 and the JIS/LANG keys.
+#define X68K_LAYOUT_DEFAULT         0
+#define X68K_LAYOUT_OPT_KEYS        1
+
+#ifndef X68K_LAYOUT
+#define X68K_LAYOUT                 X68K_LAYOUT_DEFAULT
+#endif
+
+// Gamepads and joysticks: the hat switch (or the left stick) and the buttons are keys, see
+// gamepadKeys[] in hid_translate.c, and the right stick moves the mouse at up to
+// GAMEPAD_MOUSE_SPEED USB counts per second, outside the GAMEPAD_DEADZONE (of 256).
+#ifndef GAMEPAD_MOUSE_SPEED
+#define GAMEPAD_MOUSE_SPEED         600
+#endif
+
+#ifndef GAMEPAD_DEADZONE
+#define GAMEPAD_DEADZONE            48
+#endif
+
+// Longest report gap the stick motion is counted for (the first report, a stalled bus)
+#define GAMEPAD_MOUSE_MAX_GAP_US    20000
+
+// Tables are indexed by (devAddr, instance)
+#define HID_MAX_DEVICES             (CFG_TUH_DEVICE_MAX + CFG_TUH_HUB + 1)
+#define HID_MAX_INSTANCES           4
+
+// Events for the X68000 side. hidMount()/hidUnmount()/hidReport() are the only producer.
+extern EventRing inputEvents;
+
+// Returns true if the device has to be switched back to boot protocol, as its report
+// descriptor didn't have anything usable
+bool hidMount(uint8_t devAddr, uint8_t instance, uint8_t itfProtocol, uint8_t const* desc, uint16_t descLen);
+void hidUnmount(uint8_t devAddr, uint8_t instance, uint32_t timestamp);
+
+// 'timestamp' is time_us_32() when the report arrived
+void hidReport(uint8_t devAddr, uint8_t instance, uint8_t const* report, uint16_t len, uint32_t timestamp);
+
+// Retry keyboard reports that were held back because the event ring was full
+void flushHidReports(void);
+
+// True if there is anything left for either side of the event ring to do
+bool hidReportsPending(void);
+
+// Applies the key remaps and the dump chord from the config store; call before the first mount
+void hidLoadConfig(X68kConfig const* config);
+
+// Keyboard LEDs as HID LED usages, NUM LOCK (usage 1) in bit 0. A change only marks the
+// keyboards as out of date; the platform then sends one SET_REPORT at a time from its main
+// loop, so a burst of changes ends up as a single report per keyboard.
+#define HID_LED_NUM_LOCK            0x01
+#define HID_LED_CAPS_LOCK           0x02
+#define HID_LED_SCROLL_LOCK         0x04
+#define HID_LED_COMPOSE             0x08
+#define HID_LED_KANA                0x10
+
+void hidSetLeds(uint8_t leds);
+
+// The next keyboard whose LEDs are out of date, with the output report to send it. The
+// report stays valid until hidLedsDone(), which has to be called once the transfer is over,
+// or hidLedsNotStarted() if it couldn't be started (e.g. the control pipe is busy); that one
+// is simply offered again later and doesn't count as a failed attempt.
+bool hidNextLedReport(uint8_t* devAddr, uint8_t* instance, uint8_t* reportId, uint8_t const** report, uint16_t* len);
+void hidLedsDone(uint8_t devAddr, uint8_t instance, bool ok);
+void hidLedsNotStarted(uint8_t devAddr, uint8_t instance);
+
+// Stats dump chord: CTRL+ALT+SCROLL LOCK by default, either side's modifiers count. The keys
+// still go to the X68000 as usual (SCROLL LOCK is HELP).
+#define HID_CHORD_CTRL              0x01
+#define HID_CHORD_SHIFT             0x02
+#define HID_CHORD_ALT               0x04
+#define HID_CHORD_GUI               0x08
+
+#define HID_DUMP_CHORD_MODIFIERS    (HID_CHORD_CTRL | HID_CHORD_ALT)
+#define HID_DUMP_CHORD_KEY          0x47    // HID_KEY_SCROLL_LOCK
+
+// True once after the dump chord has been pressed
+bool hidTakeDumpRequest(void);
+
+#endif
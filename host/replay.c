@@ -0,0 +1,470 @@
+// Host-side replay of recorded USB HID report traces through the hardware independent part
+// of the firmware (hid_parser.c, hid_translate.c, x68k_link.c). Simulated time runs as fast
+// as the trace can be processed; the keyboard line is paced at 2400 baud like the real one.
+//
+// Trace format, one record per line ('#' starts a comment), times in us:
+//
+//   <time> mount  <devAddr> <instance> <itfProtocol> [<report descriptor hex>]
+//   <time> umount <devAddr> <instance>
+//   <time> report <devAddr> <instance> <report hex>
+//   <time> cmd    <X68000 command byte hex>
+//   <time> msctrl
+//   <time> ready  <0|1>
+//   <time> macro  <usage hex> <flags hex> <code hex>     (see macro.h; added to the ones so far)
+//
+// Binary captures from the firmware (HID_CAPTURE, see hid_capture.h) are replayed as well,
+// or converted to the text format with -t.
+//
+// Output is the byte stream sent to the X68000, one line per keyboard byte or mouse packet
+// ("<time> keyb 1e", "<time> mouse 00 05 fe"), and the LED reports sent to the keyboards
+// ("<time> leds 1.0 02"), followed by the CPU cost per record type.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "hid_translate.h"
+#include "x68k_link.h"
+#include "latency.h"
+#include "hid_capture.h"
+#include "macro.h"
+
+#define KEYB_BYTE_US            (10 * 1000000 / 2400)   // 2400 8n1
+
+#define MAX_LINE                2048
+#define MAX_HEX                 512
+
+static uint32_t simTime         = 0;
+static uint32_t keybBusyUntil   = 0;
+static uint32_t repeatDue       = 0;
+static bool repeatArmed         = false;
+static uint32_t prebuildDue     = 0;
+static bool prebuildArmed       = false;
+static uint32_t macroDue        = 0;
+static bool macroArmed          = false;
+
+// Macro definitions from the trace, in the config record format
+static uint8_t macroDefs[CONFIG_MACRO_BYTES];
+static uint16_t macroDefsLen    = 0;
+static bool quiet               = false;
+static bool dumpTrace           = false;
+
+static uint32_t keybBytes       = 0;
+static uint32_t mousePackets    = 0;
+
+enum { COST_MOUNT, COST_UMOUNT, COST_REPORT, COST_CMD, COST_MSCTRL, COST_COUNT };
+
+static char const* costNames[COST_COUNT] = { "mount", "umount", "report", "cmd", "msctrl" };
+static LatencyHistogram costs[COST_COUNT];
+
+#if defined(__x86_64__) || defined(__i386__)
+#define COST_UNIT               "cycles"
+static uint64_t hostCycles(void)
+{
+    return __rdtsc();
+}
+#else
+#define COST_UNIT               "ns"
+static uint64_t hostCycles(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#endif
+
+uint32_t hostTimeUs(void)
+{
+    return simTime;
+}
+
+static bool before(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) < 0;
+}
+
+// Hooks for x68k_link.c
+
+void x68kKeybTxKick(void)
+{
+    uint8_t scan;
+    if (before(simTime, keybBusyUntil) || !keybTxPop(&scan))
+        return;
+
+    keybBusyUntil = simTime + KEYB_BYTE_US;
+    ++keybBytes;
+    if (!quiet)
+        printf("%10lu keyb %02x\n", (unsigned long)simTime, scan);
+}
+
+void x68kSendMouse(void)
+{
+    MouseData packet;
+    if (!x68kMousePacket(&packet))
+        return;
+
+    ++mousePackets;
+    if (!quiet)
+        printf("%10lu mouse %02x %02x %02x\n", (unsigned long)simTime, packet.data[0], packet.data[1], packet.data[2]);
+}
+
+void x68kStartRepeatTimer(uint32_t delayUs)
+{
+    repeatDue = simTime + delayUs;
+    repeatArmed = true;
+}
+
+void x68kStopRepeatTimer(void)
+{
+    repeatArmed = false;
+}
+
+void x68kStartMacroTimer(uint32_t delayUs)
+{
+    macroDue = simTime + delayUs;
+    macroArmed = true;
+}
+
+#if MOUSE_PREDICT
+void x68kStartMouseTimer(uint32_t delayUs)
+{
+    prebuildDue = simTime + delayUs;
+    prebuildArmed = true;
+}
+#endif
+
+void x68kActivity(void)
+{
+}
+
+// Runs the keyboard line and the repeat timer up to 'until'
+static void advance(uint32_t until)
+{
+    while (true)
+    {
+        // Next thing due: the keyboard line going idle, the repeat or macro timer, or the mouse prebuild
+        uint32_t next = until;
+        if (keybTxPending() && before(simTime, keybBusyUntil) && before(keybBusyUntil, next))
+            next = keybBusyUntil;
+        if (repeatArmed && before(repeatDue, next))
+            next = repeatDue;
+        if (prebuildArmed && before(prebuildDue, next))
+            next = prebuildDue;
+        if (macroArmed && before(macroDue, next))
+            next = macroDue;
+        if (before(simTime, next))
+            simTime = next;
+
+#if MOUSE_PREDICT
+        if (prebuildArmed && !before(simTime, prebuildDue))
+        {
+            prebuildArmed = false;
+            x68kMousePrebuild();
+        }
+#endif
+
+        if (repeatArmed && !before(simTime, repeatDue))
+        {
+            uint32_t interval = keyRepeatTick();
+            repeatArmed = interval != 0;
+            repeatDue += interval;
+        }
+        if (macroArmed && !before(simTime, macroDue))
+        {
+            uint32_t next = keyMacroTick();
+            macroArmed = next != 0;
+            macroDue = simTime + next;
+        }
+        x68kKeybTxKick();
+
+        if (!before(simTime, until))
+            break;
+    }
+}
+
+static int parseHex(char const* text, uint8_t* out, int maxLen)
+{
+    int len = 0;
+    while (text && text[0] && text[1] && len < maxLen)
+    {
+        unsigned value;
+        if (sscanf(text, "%2x", &value) != 1)
+            break;
+        out[len++] = value;
+        text += 2;
+    }
+    return len;
+}
+
+static void record(int type, uint64_t start)
+{
+    uint64_t cost = hostCycles() - start;
+    latencyRecord(&costs[type], cost > UINT32_MAX ? UINT32_MAX : (uint32_t)cost);
+}
+
+static void replayMount(uint8_t devAddr, uint8_t instance, uint8_t itfProtocol, uint8_t const* desc, uint16_t len)
+{
+    uint64_t start = hostCycles();
+    hidMount(devAddr, instance, itfProtocol, desc, len);
+    record(COST_MOUNT, start);
+}
+
+static void replayUmount(uint8_t devAddr, uint8_t instance)
+{
+    uint64_t start = hostCycles();
+    hidUnmount(devAddr, instance, simTime);
+    processKeybAndMouse();
+    record(COST_UMOUNT, start);
+}
+
+static void replayReport(uint8_t devAddr, uint8_t instance, uint8_t const* report, uint16_t len)
+{
+    // The same sequence as the single core main loop: callback, flush, consume
+    uint64_t start = hostCycles();
+    hidReport(devAddr, instance, report, len, simTime);
+    flushHidReports();
+    processKeybAndMouse();
+    record(COST_REPORT, start);
+}
+
+// SET_REPORTs complete right away here
+static void sendKeybLeds(void)
+{
+    hidSetLeds(x68kHidLeds());
+
+    uint8_t devAddr, instance, reportId;
+    uint8_t const* report;
+    uint16_t len;
+    while (hidNextLedReport(&devAddr, &instance, &reportId, &report, &len))
+    {
+        if (!quiet)
+        {
+            printf("%10lu leds %u.%u ", (unsigned long)simTime, devAddr, instance);
+            for (uint16_t i = 0; i < len; ++i)
+                printf("%02x", report[i]);
+            putchar('\n');
+        }
+        hidLedsDone(devAddr, instance, true);
+    }
+}
+
+// Keep retrying held back keyboard reports, as the main loop would
+static void replayIdle(void)
+{
+    flushHidReports();
+    processKeybAndMouse();
+    sendKeybLeds();
+}
+
+static bool replayLine(char* line, unsigned lineNumber)
+{
+    char* comment = strchr(line, '#');
+    if (comment)
+        *comment = 0;
+
+    unsigned long time;
+    char verb[16];
+    int consumed = 0;
+    if (sscanf(line, " %lu %15s %n", &time, verb, &consumed) < 2)
+        return strspn(line, " \t\r\n") == strlen(line);
+
+    char* args = line + consumed;
+    advance((uint32_t)time);
+
+    unsigned devAddr, instance, value;
+    char hex[2 * MAX_HEX + 1] = "";
+    uint8_t bytes[MAX_HEX];
+    uint64_t start;
+
+    if (!strcmp(verb, "mount") && sscanf(args, "%u %u %u %1024s", &devAddr, &instance, &value, hex) >= 3)
+    {
+        replayMount(devAddr, instance, value, bytes, parseHex(hex, bytes, MAX_HEX));
+    }
+    else if (!strcmp(verb, "umount") && sscanf(args, "%u %u", &devAddr, &instance) == 2)
+    {
+        replayUmount(devAddr, instance);
+    }
+    else if (!strcmp(verb, "report") && sscanf(args, "%u %u %1024s", &devAddr, &instance, hex) == 3)
+    {
+        replayReport(devAddr, instance, bytes, parseHex(hex, bytes, MAX_HEX));
+    }
+    else if (!strcmp(verb, "cmd") && sscanf(args, "%x", &value) == 1)
+    {
+        start = hostCycles();
+        x68kCommand(value);
+        record(COST_CMD, start);
+    }
+    else if (!strcmp(verb, "msctrl"))
+    {
+        start = hostCycles();
+        x68kMsctrlRequest();
+        record(COST_MSCTRL, start);
+    }
+    else if (!strcmp(verb, "ready") && sscanf(args, "%u", &value) == 1)
+    {
+        x68kSetTxInhibit(value == 0);
+    }
+    else if (!strcmp(verb, "macro") && sscanf(args, "%x %x %1024s", &devAddr, &value, hex) == 3)
+    {
+        int len = parseHex(hex, bytes, MAX_HEX);
+        if (macroDefsLen + 3 + len <= (int)sizeof(macroDefs))
+        {
+            macroDefs[macroDefsLen++] = devAddr;
+            macroDefs[macroDefsLen++] = value;
+            macroDefs[macroDefsLen++] = len;
+            memcpy(macroDefs + macroDefsLen, bytes, len);
+            macroDefsLen += len;
+        }
+        macroLoad(macroDefs, macroDefsLen);
+    }
+    else
+    {
+        fprintf(stderr, "line %u: can't parse '%s'\n", lineNumber, verb);
+        return false;
+    }
+
+    replayIdle();
+    return true;
+}
+
+// Binary stream from the firmware's HID_CAPTURE mode (see hid_capture.h), after the magic
+static bool replayCapture(FILE* capture)
+{
+    int version = fgetc(capture);
+    if (version < 1 || version > HID_CAPTURE_VERSION)
+    {
+        fprintf(stderr, "unsupported capture version\n");
+        return false;
+    }
+
+    bool first = true;
+    uint8_t header[HID_CAPTURE_HEADER_SIZE];
+    uint8_t data[65536];
+
+    while (fread(header, 1, sizeof(header), capture) == sizeof(header))
+    {
+        uint16_t len = header[3] | (header[4] << 8);
+        uint32_t timestamp = header[5] | (header[6] << 8) | (header[7] << 16) | ((uint32_t)header[8] << 24);
+        if (fread(data, 1, len, capture) != len)
+            break;
+
+        // Start the simulated clock at the first record
+        if (first)
+            simTime = timestamp;
+        first = false;
+        advance(timestamp);
+
+        bool truncated = header[0] & HID_CAPTURE_TRUNCATED;
+        header[0] &= HID_CAPTURE_TYPE_MASK;
+        if (truncated)
+            fprintf(stderr, "%lu: %s of %u.%u cut off at %u bytes in the capture\n", (unsigned long)timestamp,
+                    header[0] == HID_CAPTURE_MOUNT ? "report descriptor" : "report", header[1], header[2], len);
+
+        if (dumpTrace)
+        {
+            static char const* verbs[] = { NULL, "mount", "umount", "report" };
+            if (header[0] < 1 || header[0] > 3)
+                continue;
+
+            if (truncated)
+                printf("# cut off in the capture\n");
+            printf("%lu %s %u %u", (unsigned long)timestamp, verbs[header[0]], header[1], header[2]);
+            uint16_t i = 0;
+            if (header[0] == HID_CAPTURE_MOUNT && len)
+                printf(" %u", data[i++]);
+            if (i < len)
+                putchar(' ');
+            for (; i < len; ++i)
+                printf("%02x", data[i]);
+            putchar('\n');
+            continue;
+        }
+
+        if (header[0] == HID_CAPTURE_MOUNT && len)
+            replayMount(header[1], header[2], data[0], data + 1, len - 1);
+        else if (header[0] == HID_CAPTURE_UMOUNT)
+            replayUmount(header[1], header[2]);
+        else if (header[0] == HID_CAPTURE_REPORT)
+            replayReport(header[1], header[2], data, len);
+
+        replayIdle();
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; ++arg)
+    {
+        if (!strcmp(argv[arg], "-q"))
+            quiet = true;
+        else if (!strcmp(argv[arg], "-t"))
+            dumpTrace = true;
+        else
+            break;
+    }
+    if (arg != argc - 1)
+    {
+        fprintf(stderr, "usage: %s [-q] [-t] <trace or capture>\n"
+                        "  -q  only print the summary\n"
+                        "  -t  convert a binary capture to a text trace\n", argv[0]);
+        return 2;
+    }
+
+    FILE* trace = fopen(argv[arg], "rb");
+    if (!trace)
+    {
+        perror(argv[arg]);
+        return 1;
+    }
+
+    bool ok = true;
+    char line[MAX_LINE];
+    if (fread(line, 1, 4, trace) == 4 && !memcmp(line, HID_CAPTURE_MAGIC, 4))
+    {
+        ok = replayCapture(trace);
+    }
+    else
+    {
+        rewind(trace);
+
+        unsigned lineNumber = 0;
+        while (fgets(line, sizeof(line), trace))
+            ok &= replayLine(line, ++lineNumber);
+    }
+    fclose(trace);
+
+    if (dumpTrace)
+        return ok ? 0 : 1;
+
+    // Let the keyboard line drain (but not repeat forever)
+    x68kStopRepeatTimer();
+    macroArmed = false;
+    for (int i = 0; i < 256 && keybTxPending(); ++i)
+        advance(simTime + KEYB_BYTE_US);
+
+    printf("# %lu us simulated, %lu keyboard bytes, %lu mouse packets, %lu key / %lu mouse overflows\n",
+           (unsigned long)simTime, (unsigned long)keybBytes, (unsigned long)mousePackets,
+           (unsigned long)inputEvents.keyOverflows, (unsigned long)inputEvents.mouseOverflows);
+
+    for (int i = 0; i < COST_COUNT; ++i)
+    {
+        LatencyHistogram const* cost = &costs[i];
+        if (!cost->count)
+            continue;
+
+        printf("# %-8s n=%lu min=%lu avg=%lu p99=%lu max=%lu %s\n", costNames[i],
+               (unsigned long)cost->count, (unsigned long)cost->min,
+               (unsigned long)(cost->sum / cost->count),
+               (unsigned long)latencyPercentile(cost, 99),
+               (unsigned long)cost->max, COST_UNIT);
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+// Decoder for the firmware's binary telemetry stream (see telemetry.h), as saved from the RTT
+// channel by the debugger, e.g. openocd's "rtt server start 9091 1" into a file.
+//
+// Prints one line per record:
+//   "<ms> latency msctrl n=.. min=.. avg=.. p99=.. max=.. us"
+//   "<ms> counters key-overflows=.. mouse-overflows=.. capture-drops=.. drops=.. msctrl-period=.. us"
+//   "<ms> mount 1.0 protocol 1 poll 1 ms (device 10 ms)"
+//   "<ms> umount 1.0"
+//   "<ms> perf msctrl=../s keyb-bytes=.. ..."
+//   "<ms> reports 1:.. 2:.."
+//   "<ms> task 0 usb runs=.. max=.. late-max=.. us"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "telemetry.h"
+
+static uint32_t get32(uint8_t const* in)
+{
+    return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+static char const* latencyNames[] = { "key-queue", "key-send", "mouse-send", "msctrl", "msctrl-poll" };
+
+static void printRecord(uint8_t type, uint32_t timestamp, uint8_t const* data, uint8_t len)
+{
+    printf("%10lu ", (unsigned long)timestamp);
+
+    if (type == TELEMETRY_LATENCY && len >= 21)
+    {
+        char const* name = data[0] < sizeof(latencyNames) / sizeof(latencyNames[0]) ? latencyNames[data[0]] : "?";
+        printf("latency %s n=%lu min=%lu avg=%lu p99=%lu max=%lu us\n", name,
+               (unsigned long)get32(data + 1), (unsigned long)get32(data + 5), (unsigned long)get32(data + 9),
+               (unsigned long)get32(data + 13), (unsigned long)get32(data + 17));
+    }
+    else if (type == TELEMETRY_COUNTERS && len >= 20)
+    {
+        printf("counters key-overflows=%lu mouse-overflows=%lu capture-drops=%lu drops=%lu msctrl-period=%lu us\n",
+               (unsigned long)get32(data), (unsigned long)get32(data + 4), (unsigned long)get32(data + 8),
+               (unsigned long)get32(data + 12), (unsigned long)get32(data + 16));
+    }
+    else if (type == TELEMETRY_MOUNT && len >= 5)
+    {
+        printf("mount %u.%u protocol %u poll %u ms (device %u ms)\n", data[0], data[1], data[2], data[3], data[4]);
+    }
+    else if (type == TELEMETRY_UMOUNT && len >= 2)
+    {
+        printf("umount %u.%u\n", data[0], data[1]);
+    }
+    else if (type == TELEMETRY_PERF)
+    {
+        static char const* names[] =
+        {
+            "msctrl/s", "keyb-bytes", "mouse-bytes", "keyb-queue-max", "event-ring-max", "key-overflows",
+            "mouse-overflows", "repeats-dropped", "ready-stall-us", "tuh-task-max-us", "loop-max-us",
+            "macro-stalls", "macros-dropped", "msctrl-deferred",
+        };
+        printf("perf");
+        for (unsigned i = 0; i < sizeof(names) / sizeof(names[0]) && 4 * i + 4 <= len; ++i)
+            printf(" %s=%lu", names[i], (unsigned long)get32(data + 4 * i));
+        putchar('\n');
+    }
+    else if (type == TELEMETRY_REPORTS)
+    {
+        printf("reports");
+        for (unsigned i = 0; i + 4 <= len; i += 4)
+        {
+            if (get32(data + i))
+                printf(" %u:%lu", i / 4, (unsigned long)get32(data + i));
+        }
+        putchar('\n');
+    }
+    else if (type == TELEMETRY_TASK && len >= 13)
+    {
+        printf("task %u %.*s runs=%lu max=%lu late-max=%lu us\n", data[0], len - 13, (char const*)data + 13,
+               (unsigned long)get32(data + 1), (unsigned long)get32(data + 5), (unsigned long)get32(data + 9));
+    }
+    else
+    {
+        // Newer record types, or older firmware; skipped by length either way
+        printf("record %u, %u bytes\n", type, len);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s <telemetry dump>\n", argv[0]);
+        return 2;
+    }
+
+    FILE* in = fopen(argv[1], "rb");
+    if (!in)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    uint8_t header[TELEMETRY_HEADER_SIZE];
+    uint8_t data[256];
+    if (fread(header, 1, 5, in) != 5 || memcmp(header, TELEMETRY_MAGIC, 4) || header[4] != TELEMETRY_VERSION)
+    {
+        fprintf(stderr, "%s: not a version %u telemetry stream\n", argv[1], TELEMETRY_VERSION);
+        fclose(in);
+        return 1;
+    }
+
+    while (fread(header, 1, sizeof(header), in) == sizeof(header))
+    {
+        uint8_t len = header[1];
+        if (fread(data, 1, len, in) != len)
+            break;
+        printRecord(header[0], get32(header + 2), data, len);
+    }
+
+    fclose(in);
+    return 0;
+}
@@ -0,0 +1,694 @@
+// x68k-host-sim: firmware for a second Pico that stands in for the X68000, to check an
+// adapter's timing on the bench. It plays a USB keyboard and mouse into the adapter's USB port,
+// drives MSCTRL and READY, sends the keyboard commands, and timestamps every byte the adapter
+// sends back. A pass of the test suite runs every few seconds, and ends with the number of
+// protocol violations; results go out on RTT like the adapter's own stats.
+//
+// Wiring, sim => adapter (both 3.3V, no level shifters), plus GND:
+//   GP0 (UART0 TX) => GP1  keyboard line, X68000 commands
+//   GP1 (UART0 RX) <= GP0  keyboard line, scancodes
+//   GP5 (UART1 RX) <= GP4  mouse data
+//   GP3            => GP3  MSCTRL
+//   GP2            => GP5  READY
+//   USB            => the adapter's USB host port (an OTG adapter, the adapter powers the sim)
+//
+// The checks assume the adapter's built-in settings: the default key map, and a mouse scale of
+// 1:1 without acceleration. The limits are options, so they can be set to whatever the machine
+// being matched needs.
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/uart.h"
+#include "hardware/irq.h"
+#include "hardware/gpio.h"
+
+#include "tusb.h"
+
+#include "usb_descriptors.h"
+#include "latency.h"
+
+#define KEYB_UART       uart0
+#define KEYB_UART_TX    0
+#define KEYB_UART_RX    1
+
+#define MOUSE_UART      uart1
+#define MOUSE_UART_RX   5
+
+#define READY_GPIO      2
+#define MSCTRL_GPIO     3
+
+// One byte on the line, start bit to end of the stop bit(s)
+#define KEYB_BYTE_US    4167    // 2400 8n1
+#define MOUSE_BYTE_US   2292    // 4800 8n2
+
+// The RX interrupt comes in the middle of the (first) stop bit; bytes are timestamped with
+// their start bit
+#define KEYB_RX_DELAY_US    3958
+#define MOUSE_RX_DELAY_US   1979
+
+// X68000 commands (see x68k_link.c)
+#define KEYB_MSCTRL             0x40    // bit 0 clear: asserted
+#define KEYB_KEY_INHIBIT        0x58    // bit 0 clear: inhibited
+#define KEYB_REPEAT_DELAY       0x60    // 200 + n * 100 ms
+#define KEYB_REPEAT_INTERVAL    0x70    // 30 + n * n * 5 ms
+#define KEYB_LED_CTRL           0x80    // 0 = lit
+#define KEYB_LED_CAPS           0x08
+
+#define KEYB_BREAK              0x80
+
+// The key that gets typed: A, scancode 0x1e
+#define SIM_KEY_USAGE           HID_KEY_A
+#define SIM_KEY_SCAN            0x1e
+
+// MSCTRL on its own line (1), or as the command on the keyboard line (0)
+#ifndef SIM_MSCTRL_GPIO
+#define SIM_MSCTRL_GPIO         1
+#endif
+
+#ifndef SIM_MSCTRL_PERIOD_US
+#define SIM_MSCTRL_PERIOD_US    16667
+#endif
+
+#ifndef SIM_MSCTRL_POLLS
+#define SIM_MSCTRL_POLLS        300
+#endif
+
+// From the MSCTRL edge (or the end of the command byte) to the packet's start bit
+#ifndef SIM_MSCTRL_MAX_US
+#define SIM_MSCTRL_MAX_US       1000
+#endif
+
+// Between two packet bytes, and between the bytes of a burst after READY / key inhibit
+#ifndef SIM_BURST_SLACK_US
+#define SIM_BURST_SLACK_US      500
+#endif
+
+#ifndef SIM_KEY_ROUNDS
+#define SIM_KEY_ROUNDS          50
+#endif
+
+// From the USB report to the scancode's start bit; includes the adapter's USB poll interval
+#ifndef SIM_KEY_MAX_US
+#define SIM_KEY_MAX_US          10000
+#endif
+
+// Repeat settings under test, as in the X68000 commands
+#ifndef SIM_REPEAT_DELAY_CODE
+#define SIM_REPEAT_DELAY_CODE   3
+#endif
+
+#ifndef SIM_REPEAT_INTERVAL_CODE
+#define SIM_REPEAT_INTERVAL_CODE 2
+#endif
+
+// How far a repeat may be off the delay/interval set
+#ifndef SIM_REPEAT_TOLERANCE_US
+#define SIM_REPEAT_TOLERANCE_US 5000
+#endif
+
+// From the end of the inhibit, or READY, to the start bit of what was held back
+#ifndef SIM_RELEASE_MAX_US
+#define SIM_RELEASE_MAX_US      1000
+#endif
+
+#ifndef SIM_LED_ROUNDS
+#define SIM_LED_ROUNDS          10
+#endif
+
+// From the end of the LED command to the SET_REPORT on the keyboard
+#ifndef SIM_LED_MAX_US
+#define SIM_LED_MAX_US          20000
+#endif
+
+#ifndef SIM_PASS_GAP_MS
+#define SIM_PASS_GAP_MS         5000
+#endif
+
+// How long a key is held when it's not meant to repeat, and how long output is held off
+#define SIM_KEY_HOLD_US         30000
+#define SIM_HOLD_OFF_US         200000
+#define SIM_TIMEOUT_US          100000
+
+// %%%% Captured bytes
+
+#define SIM_RX_SIZE     256     // per line, power of two
+
+typedef struct
+{
+    uint32_t time;              // start bit, us
+    uint8_t  data;
+} SimByte;
+
+typedef struct
+{
+    SimByte bytes[SIM_RX_SIZE];
+    volatile uint32_t head;     // UART ISR
+    uint32_t tail;              // main loop
+    volatile uint32_t errors;   // framing, parity, break, overrun
+} SimRx;
+
+static SimRx keybRx;
+static SimRx mouseRx;
+
+static void __not_in_flash_func(rxPush)(SimRx* rx, uart_inst_t* uart, uint32_t time)
+{
+    while (uart_is_readable(uart))
+    {
+        uint32_t data = uart_get_hw(uart)->dr;
+        if (data & 0xf00)
+            ++rx->errors;
+        if (rx->head - rx->tail < SIM_RX_SIZE)
+        {
+            SimByte* byte = &rx->bytes[rx->head & (SIM_RX_SIZE - 1)];
+            byte->time = time;
+            byte->data = data;
+            ++rx->head;
+        }
+        else
+        {
+            ++rx->errors;
+        }
+    }
+}
+
+static void __not_in_flash_func(keybRxISR)()
+{
+    rxPush(&keybRx, KEYB_UART, time_us_32() - KEYB_RX_DELAY_US);
+}
+
+static void __not_in_flash_func(mouseRxISR)()
+{
+    rxPush(&mouseRx, MOUSE_UART, time_us_32() - MOUSE_RX_DELAY_US);
+}
+
+// %%%% Helpers
+
+static uint32_t violations  = 0;
+static uint32_t ledReports  = 0;
+static uint32_t ledTime     = 0;
+static uint8_t  leds        = 0;
+
+static void violation(char const* test, char const* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    printf("  ! %s: ", test);
+    vprintf(format, args);
+    putchar('\n');
+    va_end(args);
+    ++violations;
+}
+
+static bool before(uint32_t deadline)
+{
+    return (int32_t)(deadline - time_us_32()) > 0;
+}
+
+// Times measured from both ends can come out a few us the wrong way round
+static uint32_t elapsed(uint32_t from, uint32_t to)
+{
+    return (int32_t)(to - from) > 0 ? to - from : 0;
+}
+
+static void waitUntil(uint32_t deadline)
+{
+    while (before(deadline))
+        tud_task();
+}
+
+static void waitUs(uint32_t us)
+{
+    waitUntil(time_us_32() + us);
+}
+
+static bool take(SimRx* rx, SimByte* byte)
+{
+    if (rx->head == rx->tail)
+        return false;
+
+    *byte = rx->bytes[rx->tail & (SIM_RX_SIZE - 1)];
+    ++rx->tail;
+    return true;
+}
+
+// Next byte on the line by the deadline
+static bool receive(SimRx* rx, SimByte* byte, uint32_t deadline)
+{
+    while (!take(rx, byte))
+    {
+        if (!before(deadline))
+            return false;
+        tud_task();
+    }
+    return true;
+}
+
+// Anything still in 'rx' shouldn't have been sent
+static void expectNothing(char const* test, SimRx* rx, char const* when)
+{
+    SimByte byte;
+    while (take(rx, &byte))
+        violation(test, "%s byte %02x %s", rx == &keybRx ? "keyboard" : "mouse", byte.data, when);
+
+    if (rx->errors)
+    {
+        violation(test, "%lu %s line errors", (unsigned long)rx->errors, rx == &keybRx ? "keyboard" : "mouse");
+        rx->errors = 0;
+    }
+}
+
+static bool expectScan(char const* test, uint8_t scan, uint32_t deadline, uint32_t* time)
+{
+    SimByte byte;
+    if (!receive(&keybRx, &byte, deadline))
+    {
+        violation(test, "no %02x", scan);
+        return false;
+    }
+    if (byte.data != scan)
+    {
+        violation(test, "%02x instead of %02x", byte.data, scan);
+        return false;
+    }
+    *time = byte.time;
+    return true;
+}
+
+// Three bytes back to back; returns the start bit of the first
+static bool expectMousePacket(char const* test, uint8_t* packet, uint32_t deadline, uint32_t* time)
+{
+    SimByte byte;
+    for (int i = 0; i < 3; ++i)
+    {
+        if (!receive(&mouseRx, &byte, deadline))
+        {
+            violation(test, i ? "mouse packet cut short after %d bytes" : "no mouse packet", i);
+            return false;
+        }
+        if (i && byte.time - *time > (uint32_t)i * (MOUSE_BYTE_US + SIM_BURST_SLACK_US))
+            violation(test, "mouse byte %d %lu us into the packet", i, (unsigned long)(byte.time - *time));
+        if (!i)
+            *time = byte.time;
+
+        packet[i] = byte.data;
+        deadline = byte.time + MOUSE_RX_DELAY_US + MOUSE_BYTE_US + SIM_BURST_SLACK_US;
+    }
+    return true;
+}
+
+// Returns when it was sent: once the stop bit is out
+static uint32_t sendCommand(uint8_t ch)
+{
+    uart_putc_raw(KEYB_UART, ch);
+    uart_tx_wait_blocking(KEYB_UART);
+    return time_us_32();
+}
+
+// Returns when the report was handed over, the next USB poll takes it
+static uint32_t sendKey(uint8_t usage)
+{
+    while (!tud_hid_n_ready(SIM_ITF_KEYB))
+        tud_task();
+
+    uint8_t keys[6] = { usage };
+    uint32_t now = time_us_32();
+    tud_hid_n_keyboard_report(SIM_ITF_KEYB, 0, 0, keys);
+    return now;
+}
+
+static void sendMouse(int8_t x, int8_t y)
+{
+    while (!tud_hid_n_ready(SIM_ITF_MOUSE))
+        tud_task();
+
+    tud_hid_n_mouse_report(SIM_ITF_MOUSE, 0, 0, x, y, 0, 0);
+}
+
+// Returns the falling edge, or the end of the command byte
+static uint32_t msctrl()
+{
+#if SIM_MSCTRL_GPIO
+    gpio_put(MSCTRL_GPIO, 0);
+    uint32_t time = time_us_32();
+    busy_wait_us_32(50);
+    gpio_put(MSCTRL_GPIO, 1);
+    return time;
+#else
+    uint32_t time = sendCommand(KEYB_MSCTRL);
+    sendCommand(KEYB_MSCTRL | 0x01);
+    return time;
+#endif
+}
+
+// %%%% Tests
+
+// LED commands come back as SET_REPORTs on the keyboard
+static void testLeds()
+{
+    static LatencyHistogram latency;
+    memset(&latency, 0, sizeof(latency));
+
+    // Start from all off; the adapter only forwards changes
+    sendCommand(KEYB_LED_CTRL | 0x7f);
+    waitUs(SIM_TIMEOUT_US);
+
+    for (int i = 0; i < SIM_LED_ROUNDS; ++i)
+    {
+        bool caps = !(i & 1);
+        uint32_t reports = ledReports;
+        uint32_t sent = sendCommand(KEYB_LED_CTRL | (caps ? 0x7f & ~KEYB_LED_CAPS : 0x7f));
+
+        uint32_t deadline = sent + SIM_TIMEOUT_US;
+        while (ledReports == reports && before(deadline))
+            tud_task();
+
+        if (ledReports == reports)
+        {
+            violation("leds", "no LED report");
+        }
+        else
+        {
+            uint32_t us = elapsed(sent, ledTime);
+            latencyRecord(&latency, us);
+            if (us > SIM_LED_MAX_US)
+                violation("leds", "LED report %lu us after the command", (unsigned long)us);
+            if (leds != (caps ? KEYBOARD_LED_CAPSLOCK : 0))
+                violation("leds", "LEDs %02x, CAPS %s", leds, caps ? "on" : "off");
+        }
+        waitUs(SIM_TIMEOUT_US);
+    }
+
+    latencyPrint("leds", &latency);
+}
+
+static void testKeys()
+{
+    static LatencyHistogram latency;
+    memset(&latency, 0, sizeof(latency));
+
+    for (int i = 0; i < SIM_KEY_ROUNDS; ++i)
+    {
+        for (int release = 0; release < 2; ++release)
+        {
+            uint32_t time;
+            uint32_t sent = sendKey(release ? 0 : SIM_KEY_USAGE);
+            if (expectScan("keys", SIM_KEY_SCAN | (release ? KEYB_BREAK : 0), sent + SIM_TIMEOUT_US, &time))
+            {
+                uint32_t us = elapsed(sent, time);
+                latencyRecord(&latency, us);
+                if (us > SIM_KEY_MAX_US)
+                    violation("keys", "scancode %lu us after the report", (unsigned long)us);
+            }
+            waitUs(SIM_KEY_HOLD_US);
+        }
+    }
+
+    latencyPrint("keys", &latency);
+}
+
+// Holds the key down and times the repeats, make to make
+static void testRepeat()
+{
+    static LatencyHistogram error;
+    memset(&error, 0, sizeof(error));
+
+    uint32_t delayUs = (200 + SIM_REPEAT_DELAY_CODE * 100) * 1000;
+    uint32_t intervalUs = (30 + SIM_REPEAT_INTERVAL_CODE * SIM_REPEAT_INTERVAL_CODE * 5) * 1000;
+    uint32_t holdUs = delayUs + 20 * intervalUs + intervalUs / 2;
+    sendCommand(KEYB_REPEAT_DELAY | SIM_REPEAT_DELAY_CODE);
+    sendCommand(KEYB_REPEAT_INTERVAL | SIM_REPEAT_INTERVAL_CODE);
+
+    uint32_t release = sendKey(SIM_KEY_USAGE) + holdUs;
+    uint32_t last = 0;
+    unsigned makes = 0;
+    SimByte byte;
+    while (receive(&keybRx, &byte, release))
+    {
+        if (byte.data != SIM_KEY_SCAN)
+        {
+            violation("repeat", "%02x while the key is held", byte.data);
+            continue;
+        }
+        if (makes)
+        {
+            uint32_t expected = makes == 1 ? delayUs : intervalUs;
+            uint32_t period = elapsed(last, byte.time);
+            uint32_t us = period > expected ? period - expected : expected - period;
+            latencyRecord(&error, us);
+            if (us > SIM_REPEAT_TOLERANCE_US)
+                violation("repeat", "repeat %u after %lu us, not %lu us", makes, (unsigned long)period,
+                          (unsigned long)expected);
+        }
+        last = byte.time;
+        ++makes;
+    }
+
+    // The first make and 21 repeats
+    if (makes != 22)
+        violation("repeat", "%u makes in %lu ms, not 22", makes, (unsigned long)(holdUs / 1000));
+
+    uint32_t time;
+    expectScan("repeat", SIM_KEY_SCAN | KEYB_BREAK, sendKey(0) + SIM_TIMEOUT_US, &time);
+    waitUs(2 * intervalUs);
+    expectNothing("repeat", &keybRx, "after the release");
+
+    latencyPrint("repeat-error", &error);
+}
+
+// A key typed under key inhibit must wait, and go out as soon as the inhibit ends
+static void testInhibit()
+{
+    static LatencyHistogram latency;
+    memset(&latency, 0, sizeof(latency));
+
+    sendCommand(KEYB_KEY_INHIBIT);
+    sendKey(SIM_KEY_USAGE);
+    waitUs(SIM_KEY_HOLD_US);
+    sendKey(0);
+    waitUs(SIM_HOLD_OFF_US);
+    expectNothing("inhibit", &keybRx, "under key inhibit");
+
+    uint32_t make, release;
+    uint32_t sent = sendCommand(KEYB_KEY_INHIBIT | 0x01);
+    if (expectScan("inhibit", SIM_KEY_SCAN, sent + SIM_TIMEOUT_US, &make))
+    {
+        uint32_t us = elapsed(sent, make);
+        latencyRecord(&latency, us);
+        if (us > SIM_RELEASE_MAX_US)
+            violation("inhibit", "held back make %lu us after the inhibit ended", (unsigned long)us);
+
+        if (expectScan("inhibit", SIM_KEY_SCAN | KEYB_BREAK, make + SIM_TIMEOUT_US, &release) &&
+            release - make > KEYB_BYTE_US + SIM_BURST_SLACK_US)
+            violation("inhibit", "held back break %lu us after the make", (unsigned long)(release - make));
+    }
+
+    latencyPrint("inhibit", &latency);
+}
+
+// Same with READY, which also holds the mouse: a poll made meanwhile is answered once READY is
+// back, with all the motion
+static void testReady()
+{
+    static LatencyHistogram latency;
+    memset(&latency, 0, sizeof(latency));
+
+    gpio_put(READY_GPIO, 0);
+    sendKey(SIM_KEY_USAGE);
+    for (int i = 0; i < 4; ++i)
+        sendMouse(5, -3);
+    waitUs(SIM_KEY_HOLD_US);
+    sendKey(0);
+    msctrl();
+    waitUs(SIM_HOLD_OFF_US);
+    expectNothing("ready", &keybRx, "while READY was off");
+    expectNothing("ready", &mouseRx, "while READY was off");
+
+    gpio_put(READY_GPIO, 1);
+    uint32_t sent = time_us_32();
+
+    uint32_t make, release;
+    if (expectScan("ready", SIM_KEY_SCAN, sent + SIM_TIMEOUT_US, &make))
+    {
+        uint32_t us = elapsed(sent, make);
+        latencyRecord(&latency, us);
+        if (us > SIM_RELEASE_MAX_US)
+            violation("ready", "held back make %lu us after READY", (unsigned long)us);
+
+        if (expectScan("ready", SIM_KEY_SCAN | KEYB_BREAK, make + SIM_TIMEOUT_US, &release) &&
+            release - make > KEYB_BYTE_US + SIM_BURST_SLACK_US)
+            violation("ready", "held back break %lu us after the make", (unsigned long)(release - make));
+    }
+
+    uint8_t packet[3];
+    uint32_t time;
+    if (expectMousePacket("ready", packet, sent + SIM_TIMEOUT_US, &time))
+    {
+        uint32_t us = elapsed(sent, time);
+        latencyRecord(&latency, us);
+        if (us > SIM_RELEASE_MAX_US)
+            violation("ready", "held back mouse packet %lu us after READY", (unsigned long)us);
+        if ((int8_t)packet[1] != 20 || (int8_t)packet[2] != -12)
+            violation("ready", "motion %d,%d, not 20,-12", (int8_t)packet[1], (int8_t)packet[2]);
+    }
+
+    latencyPrint("ready", &latency);
+}
+
+// Polls at a steady rate while the mouse moves between polls; every poll must get one packet
+// in time, and all the motion must come out
+static void testMsctrl()
+{
+    static LatencyHistogram latency;
+    memset(&latency, 0, sizeof(latency));
+
+    int32_t sentX = 0, sentY = 0;
+    int32_t gotX = 0, gotY = 0;
+    uint32_t next = time_us_32();
+
+    // A few polls at the end without motion, for what the adapter still has
+    for (int i = 0; i < SIM_MSCTRL_POLLS + 4; ++i)
+    {
+        if (i < SIM_MSCTRL_POLLS)
+        {
+            int8_t x = (i & 7) - 3, y = 2 - (i % 5);
+            sendMouse(x, y);
+            sentX += x;
+            sentY += y;
+        }
+
+        next += SIM_MSCTRL_PERIOD_US;
+        waitUntil(next);
+        expectNothing("msctrl", &mouseRx, "between polls");
+
+        uint8_t packet[3];
+        uint32_t time;
+        uint32_t sent = msctrl();
+        if (expectMousePacket("msctrl", packet, sent + SIM_TIMEOUT_US, &time))
+        {
+            uint32_t us = elapsed(sent, time);
+            latencyRecord(&latency, us);
+            if (us > SIM_MSCTRL_MAX_US)
+                violation("msctrl", "packet %lu us after MSCTRL", (unsigned long)us);
+            gotX += (int8_t)packet[1];
+            gotY += (int8_t)packet[2];
+        }
+    }
+
+    if (gotX != sentX || gotY != sentY)
+        violation("msctrl", "motion %ld,%ld, not %ld,%ld", (long)gotX, (long)gotY, (long)sentX, (long)sentY);
+
+    latencyPrint("msctrl", &latency);
+}
+
+typedef struct
+{
+    char const* name;
+    void (*run)(void);
+} SimTest;
+
+static SimTest const tests[] =
+{
+    { "leds",       testLeds },
+    { "keys",       testKeys },
+    { "repeat",     testRepeat },
+    { "inhibit",    testInhibit },
+    { "ready",      testReady },
+    { "msctrl",     testMsctrl },
+};
+
+// %%%% USB device
+
+void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t const* buffer,
+                           uint16_t bufsize)
+{
+    (void)report_id;
+
+    // SET_REPORT on the control pipe, or the (unused here) OUT endpoint
+    if (instance == SIM_ITF_KEYB && report_type != HID_REPORT_TYPE_INPUT && bufsize >= 1)
+    {
+        leds = buffer[0];
+        ledTime = time_us_32();
+        ++ledReports;
+    }
+}
+
+uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t* buffer,
+                               uint16_t reqlen)
+{
+    (void)instance;
+    (void)report_id;
+    (void)report_type;
+    (void)buffer;
+    (void)reqlen;
+    return 0;
+}
+
+// %%%% Main
+
+static void setupLink()
+{
+    // Keyboard line, 2400 8n1, without the FIFO so every byte is timestamped as it comes in
+    uart_init(KEYB_UART, 2400);
+    uart_set_format(KEYB_UART, 8, 1, UART_PARITY_NONE);
+    uart_set_fifo_enabled(KEYB_UART, false);
+    gpio_set_function(KEYB_UART_TX, GPIO_FUNC_UART);
+    gpio_set_function(KEYB_UART_RX, GPIO_FUNC_UART);
+
+    // Mouse line, 4800 8n2 (the receiver only checks the first stop bit)
+    uart_init(MOUSE_UART, 4800);
+    uart_set_format(MOUSE_UART, 8, 2, UART_PARITY_NONE);
+    uart_set_fifo_enabled(MOUSE_UART, false);
+    gpio_set_function(MOUSE_UART_RX, GPIO_FUNC_UART);
+
+    // Both idle high; READY high means the X68000 takes data
+    gpio_init(MSCTRL_GPIO);
+    gpio_put(MSCTRL_GPIO, 1);
+    gpio_set_dir(MSCTRL_GPIO, GPIO_OUT);
+    gpio_init(READY_GPIO);
+    gpio_put(READY_GPIO, 1);
+    gpio_set_dir(READY_GPIO, GPIO_OUT);
+
+    irq_set_exclusive_handler(UART0_IRQ, &keybRxISR);
+    irq_set_enabled(UART0_IRQ, true);
+    uart_set_irqs_enabled(KEYB_UART, true, false);
+
+    irq_set_exclusive_handler(UART1_IRQ, &mouseRxISR);
+    irq_set_enabled(UART1_IRQ, true);
+    uart_set_irqs_enabled(MOUSE_UART, true, false);
+}
+
+int main()
+{
+    stdio_init_all();
+    setupLink();
+    tud_init(BOARD_TUD_RHPORT);
+
+    printf("x68k-host-sim\n");
+
+    // The adapter needs to enumerate both interfaces, then gets the X68000's power-on commands
+    while (!tud_mounted())
+        tud_task();
+    waitUs(1000000);
+    sendCommand(KEYB_KEY_INHIBIT | 0x01);
+    waitUs(SIM_TIMEOUT_US);
+    expectNothing("start", &keybRx, "before the first pass");
+    expectNothing("start", &mouseRx, "before the first pass");
+
+    for (uint32_t pass = 1; ; ++pass)
+    {
+        violations = 0;
+        printf("pass %lu\n", (unsigned long)pass);
+
+        for (unsigned i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i)
+        {
+            tests[i].run();
+            expectNothing(tests[i].name, &keybRx, "at the end");
+            expectNothing(tests[i].name, &mouseRx, "at the end");
+        }
+
+        printf("pass %lu: %lu violations\n", (unsigned long)pass, (unsigned long)violations);
+        waitUs(SIM_PASS_GAP_MS * 1000);
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef _TUSB_CONFIG_H_
+#define _TUSB_CONFIG_H_
+
+// x68k-host-sim: a USB keyboard and mouse on the native port, plugged into the adapter
+
+#define CFG_TUSB_MCU                OPT_MCU_RP2040
+
+#define CFG_TUD_ENABLED             1
+#define CFG_TUSB_RHPORT0_MODE       OPT_MODE_DEVICE
+#define BOARD_TUD_RHPORT            0
+
+#define CFG_TUD_ENDPOINT0_SIZE      64
+
+// Keyboard and mouse as separate boot interfaces, like most real ones
+#define CFG_TUD_HID                 2
+#define CFG_TUD_HID_EP_BUFSIZE      16
+
+#endif
@@ -0,0 +1,83 @@
+#include "tusb.h"
+
+#include "usb_descriptors.h"
+
+// pid.codes test PID; this never leaves the bench
+#define SIM_USB_VID     0x1209
+#define SIM_USB_PID     0x0001
+
+static tusb_desc_device_t const deviceDescriptor =
+{
+    .bLength            = sizeof(tusb_desc_device_t),
+    .bDescriptorType    = TUSB_DESC_DEVICE,
+    .bcdUSB             = 0x0200,
+    .bDeviceClass       = 0x00,     // per interface
+    .bDeviceSubClass    = 0x00,
+    .bDeviceProtocol    = 0x00,
+    .bMaxPacketSize0    = CFG_TUD_ENDPOINT0_SIZE,
+    .idVendor           = SIM_USB_VID,
+    .idProduct          = SIM_USB_PID,
+    .bcdDevice          = 0x0100,
+    .iManufacturer      = 0x01,
+    .iProduct           = 0x02,
+    .iSerialNumber      = 0x00,
+    .bNumConfigurations = 0x01
+};
+
+static uint8_t const keybReportDescriptor[] = { TUD_HID_REPORT_DESC_KEYBOARD() };
+static uint8_t const mouseReportDescriptor[] = { TUD_HID_REPORT_DESC_MOUSE() };
+
+#define SIM_CONFIG_LEN  (TUD_CONFIG_DESC_LEN + SIM_ITF_COUNT * TUD_HID_DESC_LEN)
+
+// Polled every ms, so the adapter's own poll interval is the one that shows in the results
+static uint8_t const configDescriptor[] =
+{
+    TUD_CONFIG_DESCRIPTOR(1, SIM_ITF_COUNT, 0, SIM_CONFIG_LEN, 0, 100),
+    TUD_HID_DESCRIPTOR(SIM_ITF_KEYB, 0, HID_ITF_PROTOCOL_KEYBOARD, sizeof(keybReportDescriptor), 0x81,
+                       CFG_TUD_HID_EP_BUFSIZE, 1),
+    TUD_HID_DESCRIPTOR(SIM_ITF_MOUSE, 0, HID_ITF_PROTOCOL_MOUSE, sizeof(mouseReportDescriptor), 0x82,
+                       CFG_TUD_HID_EP_BUFSIZE, 1),
+};
+
+uint8_t const* tud_descriptor_device_cb(void)
+{
+    return (uint8_t const*)&deviceDescriptor;
+}
+
+uint8_t const* tud_descriptor_configuration_cb(uint8_t index)
+{
+    (void)index;
+    return configDescriptor;
+}
+
+uint8_t const* tud_hid_descriptor_report_cb(uint8_t instance)
+{
+    return instance == SIM_ITF_KEYB ? keybReportDescriptor : mouseReportDescriptor;
+}
+
+uint16_t const* tud_descriptor_string_cb(uint8_t index, uint16_t langid)
+{
+    (void)langid;
+    static char const* strings[] = { NULL, "x68k-hid", "X68000 host simulator" };
+    static uint16_t descriptor[32];
+
+    uint8_t len;
+    if (index == 0)
+    {
+        descriptor[1] = 0x0409;     // English
+        len = 1;
+    }
+    else if (index < sizeof(strings) / sizeof(strings[0]))
+    {
+        char const* string = strings[index];
+        for (len = 0; string[len] && len < 31; ++len)
+            descriptor[1 + len] = string[len];
+    }
+    else
+    {
+        return NULL;
+    }
+
+    descriptor[0] = (TUSB_DESC_STRING << 8) | (2 * len + 2);
+    return descriptor;
+}
@@ -0,0 +1,12 @@
+#ifndef _USB_DESCRIPTORS_H_
+#define _USB_DESCRIPTORS_H_
+
+// HID interfaces, also the instance numbers for tud_hid_n_xxx()
+enum
+{
+    SIM_ITF_KEYB,
+    SIM_ITF_MOUSE,
+    SIM_ITF_COUNT
+};
+
+#endif
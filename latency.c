@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "latency.h"
+
+static uint32_t binIndex(uint32_t us)
+{
+    if (us < 8)
+        return us;
+
+    uint32_t msb = 31 - __builtin_clz(us);
+    return 8 + (msb - 3) * 4 + ((us >> (msb - 2)) & 3);
+}
+
+static uint32_t binUpperBound(uint32_t bin)
+{
+    if (bin < 8)
+        return bin;
+
+    uint32_t msb = (bin - 8) / 4 + 3;
+    uint32_t sub = (bin - 8) % 4;
+    return ((4 + sub + 1) << (msb - 2)) - 1;
+}
+
+void latencyRecord(LatencyHistogram* histogram, uint32_t us)
+{
+    if (!histogram->count || us < histogram->min)
+        histogram->min = us;
+    if (us > histogram->max)
+        histogram->max = us;
+
+    histogram->sum += us;
+    histogram->count++;
+    histogram->bins[binIndex(us)]++;
+}
+
+uint32_t latencyPercentile(LatencyHistogram const* histogram, uint32_t percent)
+{
+    if (!histogram->count)
+        return 0;
+
+    // Rank of the sample at the percentile, rounded up
+    uint32_t rank = (uint32_t)(((uint64_t)histogram->count * percent + 99) / 100);
+    uint32_t seen = 0;
+
+    for (uint32_t bin = 0; bin < LATENCY_BINS; ++bin)
+    {
+        seen += histogram->bins[bin];
+        if (seen >= rank)
+        {
+            uint32_t bound = binUpperBound(bin);
+            return bound < histogram->max ? bound : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
+
+void latencyPrint(char const* name, LatencyHistogram const* histogram)
+{
+    // Copy first, the ISRs keep recording while this is being printed
+    LatencyHistogram snapshot;
+    memcpy(&snapshot, histogram, sizeof(snapshot));
+
+    if (!snapshot.count)
+    {
+        printf("%-12s n=0\n", name);
+        return;
+    }
+
+    printf("%-12s n=%lu min=%lu avg=%lu p99=%lu max=%lu us\n", name,
+           (unsigned long)snapshot.count,
+           (unsigned long)snapshot.min,
+           (unsigned long)(snapshot.sum / snapshot.count),
+           (unsigned long)latencyPercentile(&snapshot, 99),
+           (unsigned long)snapshot.max);
+}
@@ -0,0 +1,29 @@
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <stdint.h>
+
+// Latency histograms in microseconds. Bins are linear below 8 us, then 4 per octave, so the
+// percentiles come out within 25% at any scale with a fixed 128 bins.
+// Each histogram must only be recorded from one context (one ISR, or one thread).
+
+#define LATENCY_BINS            128
+
+typedef struct
+{
+    uint32_t count;
+    uint64_t sum;
+    uint32_t min;
+    uint32_t max;
+    uint32_t bins[LATENCY_BINS];
+} LatencyHistogram;
+
+void latencyRecord(LatencyHistogram* histogram, uint32_t us);
+
+// Upper bound of the bin holding the given percentile (0-100), capped at the maximum
+uint32_t latencyPercentile(LatencyHistogram const* histogram, uint32_t percent);
+
+// One line of count/min/avg/p99/max on stdout
+void latencyPrint(char const* name, LatencyHistogram const* histogram);
+
+#endif
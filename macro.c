@@ -0,0 +1,84 @@
+#include <string.h>
+
+#include "x68k_platform.h"
+#include "config.h"
+#include "macro.h"
+
+// Copied out of the config record, so playing a sequence never reads flash
+static uint8_t macroCode[CONFIG_MACRO_BYTES] PLATFORM_SCRATCH_X("macroCode");
+static Macro macros[MACRO_MAX] PLATFORM_SCRATCH_X("macros");
+static uint8_t macroCount           = 0;
+
+// Checks the code and works out how long one pass takes, in bytes sent and time waited
+static bool checkMacro(uint8_t const* code, uint8_t len, uint32_t* keyBytes, uint32_t* waitUs)
+{
+    *keyBytes = 0;
+    *waitUs = 0;
+
+    for (uint32_t pc = 0; pc < len; ++pc)
+    {
+        if (code[pc] == MACRO_WAIT)
+        {
+            if (++pc == len)
+                return false;
+            *waitUs += code[pc] * 1000;
+        }
+        else if (code[pc] == 0x00)
+        {
+            return false;
+        }
+        else
+        {
+            ++*keyBytes;
+        }
+    }
+    return true;
+}
+
+uint8_t macroLoad(uint8_t const* defs, uint16_t len)
+{
+    uint32_t used = 0;
+    macroCount = 0;
+
+    uint32_t i = 0;
+    while (i + 3 <= len && defs[i] && macroCount < MACRO_MAX)
+    {
+        uint8_t usage = defs[i];
+        uint8_t flags = defs[i + 1];
+        uint8_t codeLen = defs[i + 2];
+        uint8_t const* code = defs + i + 3;
+        i += 3 + codeLen;
+        if (i > len || used + codeLen > sizeof(macroCode))
+            break;
+
+        // The modifiers (0xe0-0xe7) go straight to their scancodes and are never looked up
+        uint32_t keyBytes, waitUs;
+        if ((usage >= 0xe0 && usage <= 0xe7) || !codeLen || !checkMacro(code, codeLen, &keyBytes, &waitUs) || macroFind(usage) != MACRO_NONE)
+            continue;
+
+        // A loop has to leave the line time to send it, or it would only ever fall behind
+        if ((flags & MACRO_LOOP) && waitUs < keyBytes * MACRO_BYTE_US)
+            continue;
+
+        memcpy(macroCode + used, code, codeLen);
+        macros[macroCount++] = (Macro){ usage, flags, codeLen, macroCode + used };
+        used += codeLen;
+    }
+
+    return macroCount;
+}
+
+uint8_t PLATFORM_RAM_FUNC(macroFind)(uint8_t usage)
+{
+    for (uint8_t i = 0; i < macroCount; ++i)
+    {
+        if (macros[i].usage == usage)
+            return i;
+    }
+    return MACRO_NONE;
+}
+
+Macro const* PLATFORM_RAM_FUNC(macroGet)(uint8_t index)
+{
+    return index < macroCount ? &macros[index] : NULL;
+}
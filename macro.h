@@ -0,0 +1,51 @@
+#ifndef _MACRO_H_
+#define _MACRO_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Key macros and turbo: a USB key (or gamepad button, through its key in gamepadKeys[]) bound
+// to a timed sequence of X68000 scancodes. hid_translate.c turns the bound key into
+// EVENT_MACRO events instead of its own scancode, and x68k_link.c plays the sequence off its
+// own alarm, the same way key repeat runs.
+//
+// The definitions live in the config record (X68kConfig.macros), one after the other, up to
+// a 0 usage:
+//   uint8 usage        HID keyboard page usage, not a modifier
+//   uint8 flags        MACRO_LOOP: start over for as long as the key is held; else it runs
+//                      to the end once per press
+//   uint8 len          of code[]
+//   uint8 code[len]    0x01-0x7f MAKE, 0x81-0xff BREAK of that scancode,
+//                      MACRO_WAIT n waits n ms (counted from the previous deadline)
+// Keys a sequence still holds at its end (or when a loop's key is released) get their BREAK.
+//
+// e.g. 30 Hz turbo on Z (usage 0x1d, scancode 0x2a): 1d 01 06  2a 80 10 aa 80 11
+
+#define MACRO_WAIT              0x80
+#define MACRO_LOOP              0x01
+
+#define MACRO_MAX               8
+#define MACRO_NONE              0xff
+
+// 2400 8n1, the time one scancode takes on the keyboard line
+#define MACRO_BYTE_US           (10 * 1000000 / 2400)
+
+typedef struct
+{
+    uint8_t usage;
+    uint8_t flags;
+    uint8_t len;
+    uint8_t const* code;
+} Macro;
+
+// Replaces the definitions. A macro that's malformed or bound to a modifier, or a loop that
+// sends more than the keyboard line can carry in its waits, is left out. Returns the number
+// accepted. Call before the first mount, like hidLoadConfig().
+uint8_t macroLoad(uint8_t const* defs, uint16_t len);
+
+// MACRO_NONE if the usage isn't bound
+uint8_t macroFind(uint8_t usage);
+
+Macro const* macroGet(uint8_t index);
+
+#endif
@@ -1,9 +1,28 @@
 #include <stdio.h>
+#include <string.h>
 #include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/sync.h"
 #include "hardware/uart.h"
+#include "hardware/irq.h"
+#include "hardware/dma.h"
+#include "hardware/structs/scb.h"
 #include "bsp/board_api.h"
 
 #include "tusb.h"
+#include "hid_translate.h"
+#include "x68k_link.h"
+#include "hid_capture.h"
+#include "SEGGER_RTT.h"
+#include "hid_poll.h"
+#include "config.h"
+#include "telemetry.h"
+#include "scheduler.h"
+#include "macro.h"
+
+#if X68K_PIO_USB
+#include "pio_usb.h"
+#endif
 
 // Keyboard on UART0 (bi-directional)
 #define KEYB_UART       uart0
@@ -19,21 +38,179 @@
 #define MSCTRL_GPIO     3   // => "MSCTRL"    (pin 2, Mouse Mini-DIN 5-pin)
 #define READY_GPIO      5   // => "READY"     (pin 5, Keyboard Mini-DIN 7-pin)
 
+// USB host root ports with X68K_PIO_USB (see tusb_config.h); D- is always D+ + 1
+#define PIO_USB_DP_GPIO     6   // root port 1
+#define PIO_USB2_DP_GPIO    8   // root port 2, so a keyboard and a mouse don't need a hub
+#define PIO_USB_DMA_CHANNEL 11  // top channel, clear of dma_claim_unused_channel() for the mouse
+
+// Mouse packets are latched on MSCTRL and sent by DMA (1), or written from the ISR (0)
+#ifndef MOUSE_TX_DMA
+#define MOUSE_TX_DMA    1
+#endif
+
+// Run the X68000 side (command decoder, key repeat, mouse packets, READY/MSCTRL) on core1 (1),
+// or interleaved with tuh_task() on core0 (0). PIO-USB runs the USB transactions from its
+// SOF timer IRQ, which would hold up MSCTRL on the same core, so it defaults to core1 there.
+#ifndef X68K_ON_CORE1
+#define X68K_ON_CORE1   X68K_PIO_USB
+#endif
+
+// Send the stats and USB mounts as binary records on their own RTT channel (1), or print
+// them on stdio (0). See telemetry.h.
+#ifndef TELEMETRY
+#define TELEMETRY           1
+#endif
+
+// Stats (the counters, and the latencies with LATENCY_STATS set, see x68k_link.h) go out this often
+#ifndef LATENCY_DUMP_MS
+#define LATENCY_DUMP_MS     10000
+#endif
+
+#if LATENCY_STATS || TELEMETRY
+static void dumpStats();
+#endif
+
+// Capture the raw HID traffic and stream it on its own RTT channel (1), or don't (0).
+// See hid_capture.h.
+#ifndef HID_CAPTURE
+#define HID_CAPTURE         0
+#endif
+
+#if HID_CAPTURE
+// Next to stdio (0) and telemetry (1); the SDK's RTT config has 3 up-channels
+#ifndef HID_CAPTURE_RTT_CHANNEL
+#define HID_CAPTURE_RTT_CHANNEL     2
+#endif
+
+#ifndef HID_CAPTURE_RTT_BUFFER_SIZE
+#define HID_CAPTURE_RTT_BUFFER_SIZE 4096
+#endif
+
+_Static_assert(HID_CAPTURE_RTT_BUFFER_SIZE > HID_CAPTURE_MAX_RECORD, "the largest capture record must fit in RTT");
+
+// Bytes written to RTT per main loop pass, so streaming never holds up tuh_task()
+#define HID_CAPTURE_DRAIN   256
+
+static void setupHidCapture();
+
+static bool drainHidCapture();
+#endif
+
 static void gpioISR(uint gpio, uint32_t events);
 static void uartISR();
+static void keybUartISR();
 
-static void processKeybAndMouse(uint32_t deltaTime);
-static void flashActivityLED(uint32_t flashRate);
+static void setupMouseDMA();
+static void setupKeyRepeat();
+static void setupUsbHost();
 
-int main()
+// Activity LED, blinking at 100 ms while there's X68000 traffic and at 500 ms otherwise.
+// The hot paths only set the flag, the LED itself is a low priority task.
+#define ACTIVITY_LED_MS         100
+#define ACTIVITY_IDLE_TICKS     5
+
+static volatile bool activitySeen   = false;
+
+static void activityLedTask();
+
+// Config changes are saved once there hasn't been a HID report for this long, and the X68000
+// link is quiet too (see config.h)
+#define CONFIG_IDLE_MS      3000
+#define CONFIG_CHECK_MS     1000
+
+static void saveConfigWhenIdle(bool busy);
+
+// Always-on counters, sent on the dump chord (see hid_translate.h) along with the ones in
+// x68k_link.h and the event ring
+static uint32_t reportsReceived[HID_MAX_DEVICES];
+static uint32_t keybBytesSent       = 0;    // written from the keyboard UART IRQ
+static uint32_t mouseBytesSent      = 0;    // written from the MSCTRL IRQ
+static uint32_t tuhTaskMaxUs        = 0;    // since the last dump
+static uint32_t loopMaxUs           = 0;
+
+static void dumpCounters();
+static void sendKeybLeds();
+
+// Upper bound for sleeping in __wfe() when nothing else is due
+#define IDLE_MAX_MS     10
+
+// %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+//
+// Core0 tasks (see scheduler.h), highest priority first
+//
+
+static bool captureBusy             = false;
+
+#if !X68K_ON_CORE1
+static void linkTask()
 {
-    stdio_init_all();
-    board_init();
-    tusb_init();
+    processKeybAndMouse();
+}
+#endif
+
+static void usbTask()
+{
+    uint32_t start = time_us_32();
+    tuh_task();
+    uint32_t taskUs = time_us_32() - start;
+    if (taskUs > tuhTaskMaxUs)
+        tuhTaskMaxUs = taskUs;
+
+    flushHidReports();
+    sendKeybLeds();
+}
+
+static void configTask()
+{
+    saveConfigWhenIdle(hidReportsPending() || captureBusy);
+}
+
+static void dumpChordTask()
+{
+    if (hidTakeDumpRequest())
+        dumpCounters();
+}
+
+#if HID_CAPTURE
+static void captureTask()
+{
+    captureBusy = drainHidCapture();
+}
+#endif
+
+static SchedulerTask mainTasks[] =
+{
+#if !X68K_ON_CORE1
+    SCHEDULER_TASK("link",      linkTask,       0),
+#endif
+    SCHEDULER_TASK("usb",       usbTask,        0),
+    SCHEDULER_TASK("config",    configTask,     CONFIG_CHECK_MS * 1000),
+    SCHEDULER_TASK("dump",      dumpChordTask,  10000),
+#if HID_CAPTURE
+    SCHEDULER_TASK("capture",   captureTask,    0),
+#endif
+#if LATENCY_STATS || TELEMETRY
+    SCHEDULER_TASK("stats",     dumpStats,      LATENCY_DUMP_MS * 1000),
+#endif
+    SCHEDULER_TASK("led",       activityLedTask, ACTIVITY_LED_MS * 1000),
+};
 
+static uint32_t schedulerClock()
+{
+    return time_us_32();
+}
+
+static Scheduler mainScheduler      = { mainTasks, sizeof(mainTasks) / sizeof(mainTasks[0]), schedulerClock };
+
+static void setupX68kLink()
+{
     // Keyboard UART (2400 8n1)
     uart_init(KEYB_UART, 2400);
     uart_set_format(KEYB_UART, 8, 1, UART_PARITY_NONE);
+    // Single-byte holding register instead of the 32-deep FIFO. The RX IRQ then fires on every
+    // command byte (with the FIFO it needs >=4 chars, or a 32 bitclock timeout), the TX IRQ fires
+    // per byte, and txInhibit/keyInhibit take effect at the next byte rather than after a full FIFO
+    uart_set_fifo_enabled(KEYB_UART, false);
     gpio_set_function(KEYB_UART_TX, GPIO_FUNC_UART);
     gpio_set_function(KEYB_UART_RX, GPIO_FUNC_UART);
 
@@ -41,6 +218,7 @@ int main()
     uart_init(MOUSE_UART, 4800);
     uart_set_format(MOUSE_UART, 8, 2, UART_PARITY_NONE);
     gpio_set_function(MOUSE_UART_TX, GPIO_FUNC_UART);
+    setupMouseDMA();
 
     // MSCTRL and READY
     gpio_set_function(MSCTRL_GPIO, GPIO_FUNC_SIO);
@@ -54,46 +232,138 @@ int main()
     gpio_set_dir(READY_GPIO, GPIO_IN);
 
     gpio_set_irq_enabled_with_callback(READY_GPIO, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true, &gpioISR);
+    x68kSetTxInhibit(!gpio_get(READY_GPIO));
 
-    while (uart_is_readable(KEYB_UART))
-        uart_getc(KEYB_UART);
+    setupKeyRepeat();
 
-    // UART IRQ is not used
-    if (0)
-    {
-        irq_set_exclusive_handler(UART0_IRQ, &uartISR);
-        irq_set_enabled(UART0_IRQ, true);
-        uart_set_irqs_enabled(KEYB_UART, true, false);
-    }
+    // UART IRQ decodes X68000 commands and drains the keyboard TX queue
+    irq_set_exclusive_handler(UART0_IRQ, &keybUartISR);
+    irq_set_enabled(UART0_IRQ, true);
+    hw_set_bits(&uart_get_hw(KEYB_UART)->imsc, UART_UARTIMSC_RXIM_BITS);
+}
+
+// Sleep until an interrupt (USB, UART, GPIO, DMA), a SEV from the other core, or the timeout.
+// MSCTRL and the X68000 commands are handled in their ISRs, so they are never delayed by this.
+static void idleWait(uint32_t timeoutUs)
+{
+    if (timeoutUs)
+        best_effort_wfe_or_timeout(make_timeout_time_us(timeoutUs));
+}
+
+static void enableWakeOnPending()
+{
+    // An interrupt that becomes pending right before __wfe() will still wake it (per core)
+    hw_set_bits(&scb_hw->scr, M0PLUS_SCR_SEVONPEND_BITS);
+}
+
+#if X68K_ON_CORE1
+// IRQ handlers are per-core, so everything X68000-facing is set up from here
+static void core1Main()
+{
+    // Lets core0 pause this core while it writes the config to flash
+    multicore_lockout_victim_init();
+    enableWakeOnPending();
+    setupX68kLink();
 
-    uint32_t lastTimer = board_millis();
     while (true)
     {
-        uint32_t currentTimer = board_millis();
-        uint32_t deltaTime = currentTimer - lastTimer;
-        lastTimer = currentTimer;
+        processKeybAndMouse();
+
+        // Core0 signals new HID reports with __sev()
+        if (!hidReportsPending())
+            idleWait(IDLE_MAX_MS * 1000);
+    }
+}
+#endif
+
+int main()
+{
+#if X68K_PIO_USB
+    // PIO-USB bit-bangs full speed USB and needs a system clock that's a multiple of 12 MHz
+    set_sys_clock_khz(120000, true);
+#endif
+
+    // Before the X68000 link, as it may set up the board's default UART, i.e. the keyboard one
+    board_init();
+
+    X68kConfig const* config = configLoad();
+    hidLoadConfig(config);
+    x68kLoadConfig(config);
+    macroLoad(config->macros, sizeof(config->macros));
 
-        flashActivityLED(500);
+    enableWakeOnPending();
 
-        tuh_task();
+    // The X68000 side comes up first, so it's listening by the time the X68000 sends its
+    // power-on commands (LEDs, repeat, MSCTRL). USB enumeration takes hundreds of ms after
+    // this, and the devices show up through the event ring whenever they're ready.
+#if X68K_ON_CORE1
+    multicore_launch_core1(core1Main);
+#else
+    setupX68kLink();
+#endif
 
-        processKeybAndMouse(deltaTime);
+    stdio_init_all();
+#if TELEMETRY
+    telemetryInit();
+#endif
+#if HID_CAPTURE
+    setupHidCapture();
+#endif
+
+    // Report protocol lets the descriptor parser see NKRO and high resolution fields;
+    // devices with a descriptor we can't use are switched back to boot protocol on mount
+    tuh_hid_set_default_protocol(HID_PROTOCOL_REPORT);
+    setupUsbHost();
+
+    schedulerStart(&mainScheduler);
+    while (true)
+    {
+        uint32_t loopStart = time_us_32();
+        uint32_t untilDue = schedulerRun(&mainScheduler);
+        uint32_t loopUs = time_us_32() - loopStart;
+        if (loopUs > loopMaxUs)
+            loopMaxUs = loopUs;
+
+        // Held back reports are retried every ms; otherwise sleep until the next deadline
+        uint32_t waitUs = hidReportsPending() || captureBusy ? 1000 : untilDue;
+        if (waitUs > IDLE_MAX_MS * 1000)
+            waitUs = IDLE_MAX_MS * 1000;
+
+        if (!tuh_task_event_ready())
+            idleWait(waitUs);
     }
 }
 
-static void flashActivityLED(uint32_t flashRate)
+static void setupUsbHost()
 {
-    static uint32_t lastUpdated = 0;
-    static bool activityLED = false;\
+#if X68K_PIO_USB
+    // PIO-USB claims a fixed DMA channel; the mouse one (claimed first) is the lowest free one
+    pio_usb_configuration_t config = PIO_USB_DEFAULT_CONFIG;
+    config.pin_dp = PIO_USB_DP_GPIO;
+    config.tx_ch = PIO_USB_DMA_CHANNEL;
+    tuh_configure(BOARD_TUH_RHPORT, TUH_CFGID_RPI_PIO_USB_CONFIGURATION, &config);
+    tuh_init(BOARD_TUH_RHPORT);
+
+    // Each root port has its own bus, so a keyboard and a mouse on separate ports never
+    // share a frame schedule or wait for hub enumeration
+    pio_usb_host_add_port(PIO_USB2_DP_GPIO, PIO_USB_PINOUT_DPDM);
+#else
+    tusb_init();
+#endif
+}
 
-    uint32_t currentTimer = board_millis();
+static void activityLedTask()
+{
+    static uint8_t ticks = 0;
+    static bool activityLED = false;
 
-    if ((currentTimer - lastUpdated) < flashRate)
+    if (!activitySeen && ++ticks < ACTIVITY_IDLE_TICKS)
         return;
 
-    board_led_write(activityLED);
+    activitySeen = false;
+    ticks = 0;
     activityLED = !activityLED;
-    lastUpdated += flashRate;
+    board_led_write(activityLED);
 }
 
 // %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -101,26 +371,96 @@ static void flashActivityLED(uint32_t flashRate)
 // TinyUSB callbacks
 //
 
-static void processKeybReport(hid_keyboard_report_t const *report);
-static void processMouseReport(hid_mouse_report_t const * report);
+// Called with the configuration descriptor before the class drivers open their endpoints, so
+// the HID polling intervals can still be lowered (see hid_poll.h). The descriptor sits in
+// TinyUSB's enumeration buffer, which the drivers are opened from next.
+bool tuh_enum_descriptor_configuration_cb(uint8_t devAddr, uint8_t cfgIndex, tusb_desc_configuration_t const* descConfig)
+{
+    uint16_t vid = 0, pid = 0;
+    tuh_vid_pid_get(devAddr, &vid, &pid);
+
+    hidPollPatchConfig(devAddr, vid, pid, tuh_speed_get(devAddr) == TUSB_SPEED_LOW, (uint8_t*)descConfig,
+                       tu_le16toh(descConfig->wTotalLength));
+    return true;
+}
 
 void tuh_hid_mount_cb(uint8_t devAddr, uint8_t instance, uint8_t const* descReport, uint16_t descLen)
 {
+    uint8_t const proto = tuh_hid_interface_protocol(devAddr, instance);
+
+#if HID_CAPTURE
+    hidCaptureRecord(HID_CAPTURE_MOUNT, devAddr, instance, time_us_32(), &proto, 1, descReport, descLen);
+#endif
+
+    if (hidMount(devAddr, instance, proto, descReport, descLen))
+        tuh_hid_set_protocol(devAddr, instance, HID_PROTOCOL_BOOT);
+
+#if TELEMETRY
+    uint8_t data[5] = { devAddr, instance, proto, hidPollInterval(devAddr, instance), hidPollDeviceInterval(devAddr, instance) };
+    telemetryWrite(TELEMETRY_MOUNT, board_millis(), data, sizeof(data));
+#else
+    printf("hid %u.%u: protocol %u, polled every %u ms (device asked for %u ms)\n", devAddr, instance, proto,
+           hidPollInterval(devAddr, instance), hidPollDeviceInterval(devAddr, instance));
+#endif
+
     tuh_hid_receive_report(devAddr, instance);
 }
 
+void tuh_hid_umount_cb(uint8_t devAddr, uint8_t instance)
+{
+    uint32_t timestamp = time_us_32();
+
+#if HID_CAPTURE
+    hidCaptureRecord(HID_CAPTURE_UMOUNT, devAddr, instance, timestamp, NULL, 0, NULL, 0);
+#endif
+
+    hidUnmount(devAddr, instance, timestamp);
+
+#if TELEMETRY
+    uint8_t data[2] = { devAddr, instance };
+    telemetryWrite(TELEMETRY_UMOUNT, board_millis(), data, sizeof(data));
+#endif
+}
+
+static uint32_t lastReportMs = 0;
+
 void tuh_hid_report_received_cb(uint8_t devAddr, uint8_t instance, const uint8_t *report, uint16_t len)
 {
-    uint8_t const proto = tuh_hid_interface_protocol(devAddr, instance);
+    uint32_t timestamp = time_us_32();
+    lastReportMs = board_millis();
+    if (devAddr < HID_MAX_DEVICES)
+        ++reportsReceived[devAddr];
 
-    if (proto == HID_ITF_PROTOCOL_KEYBOARD)
-        processKeybReport( (hid_keyboard_report_t const*) report );
-    else if (proto == HID_ITF_PROTOCOL_MOUSE)
-        processMouseReport( (hid_mouse_report_t const*) report );
+#if HID_CAPTURE
+    hidCaptureRecord(HID_CAPTURE_REPORT, devAddr, instance, timestamp, NULL, 0, report, len);
+#endif
 
+    hidReport(devAddr, instance, report, len, timestamp);
     tuh_hid_receive_report(devAddr, instance);
 }
 
+// One SET_REPORT at a time: TinyUSB has a single control transfer in flight per device, and
+// the interrupt endpoints keep running meanwhile, so nothing here waits on the keyboard
+static void sendKeybLeds()
+{
+    hidSetLeds(x68kHidLeds());
+
+    uint8_t devAddr, instance, reportId;
+    uint8_t const* report;
+    uint16_t len;
+    if (!hidNextLedReport(&devAddr, &instance, &reportId, &report, &len))
+        return;
+
+    // Tried again on the next pass, e.g. once SET_PROTOCOL after mounting is done
+    if (!tuh_hid_set_report(devAddr, instance, reportId, HID_REPORT_TYPE_OUTPUT, (void*)report, len))
+        hidLedsNotStarted(devAddr, instance);
+}
+
+void tuh_hid_set_report_complete_cb(uint8_t devAddr, uint8_t instance, uint8_t reportId, uint8_t reportType, uint16_t len)
+{
+    hidLedsDone(devAddr, instance, len != 0);
+}
+
 int tuh_printf(const char *format, ...)
 {
     return 0;
@@ -131,373 +471,413 @@ int tuh_printf(const char *format, ...)
 // x68-HID code
 //
 
-// x68000 state
-static bool txInhibit               = false;
-static bool keyInhibit              = false;
-static bool msctrlAsserted          = false;
-
-static uint8_t currentLedLevel      = 0;
-static uint8_t currentLedState      = 0;
-
-static uint16_t keyRepeatDelay      = 500; // ms
-static uint16_t keyRepeatInterval   = 110; // ms
+static alarm_pool_t* x68kAlarmPool  = NULL;
+static alarm_id_t keyRepeatAlarm    = 0;
 
-// USB HID state
-static int16_t dx = 0, dy = 0;
-static bool lmbPressed              = false;
-static bool rmbPressed              = false;
-static hid_keyboard_report_t prevReport = { 0, 0, {0} };
-static uint8_t keyRepeatKeyCode     = 0x00;
-static int32_t keyRepeatCountdown   = 0;
 
-static void sendMouse();
-
-static void gpioISR(uint gpio, uint32_t events)
+static void __not_in_flash_func(gpioISR)(uint gpio, uint32_t events)
 {
     if (gpio == MSCTRL_GPIO && (events & GPIO_IRQ_EDGE_FALL))
     {
-        sendMouse();
+        x68kMsctrlRequest();
     }
-    else if (gpio = READY_GPIO)
+    else if (gpio == READY_GPIO)
     {
-        txInhibit = (events & GPIO_IRQ_EDGE_FALL);
+        // The level, not the edge: both edges may be pending by the time this runs
+        x68kSetTxInhibit(!gpio_get(READY_GPIO));
     }
 }
 
-// These are taken from the 'X68000 Technical Guide.pdf', Chapter 5.
+// Must be called from the UART IRQ, or with interrupts disabled
+static void __not_in_flash_func(keybTxDrain)()
+{
+    uint8_t scan;
+    while (uart_is_writable(KEYB_UART) && keybTxPop(&scan))
+    {
+        uart_putc_raw(KEYB_UART, scan);
+        ++keybBytesSent;
+    }
+
+    // Only keep the TX IRQ armed while there is something we are allowed to send
+    bool armed = keybTxPending();
+    hw_write_masked(&uart_get_hw(KEYB_UART)->imsc, armed ? UART_UARTIMSC_TXIM_BITS : 0, UART_UARTIMSC_TXIM_BITS);
+}
+
+static void __not_in_flash_func(keybTxKick)()
+{
+    uint32_t status = save_and_disable_interrupts();
+    keybTxDrain();
+    restore_interrupts(status);
+}
 
-#define KEYB_MSCTRL                 0b01000000
-#define KEYB_MSCTRL_MASK            0b11111000
-#define KEYB_LED_BRIGHTNESS         0b01010100
-#define KEYB_LED_BRIGHTNESS_MASK    0b11111100
-#define KEYB_KEY_INHIBIT            0b01011000
-#define KEYB_KEY_INHIBIT_MASK       0b11111000
-#define KEYB_REPEAT_DELAY           0b01100000
-#define KEYB_REPEAT_INTERVAL        0b01110000
-#define KEYB_REPEAT_MASK            0b11110000
-#define KEYB_LED_CTRL_MASK          0b10000000
+static void __not_in_flash_func(keybUartISR)()
+{
+    uartISR();
+    keybTxDrain();
+}
 
-static void uartISR()
+static void __not_in_flash_func(uartISR)()
 {
+    // Anything already received at power-on is a real command, only noise (e.g. the line
+    // coming up) is dropped: bytes with a framing, parity or break error
     while (uart_is_readable(KEYB_UART))
     {
-        uint8_t ch = uart_getc(KEYB_UART);
-
-        if ((ch & KEYB_MSCTRL_MASK) == KEYB_MSCTRL)
-        {
-            msctrlAsserted = (ch & 0x01) == 0;
-        }
-        else if ((ch & KEYB_LED_BRIGHTNESS_MASK) == KEYB_LED_BRIGHTNESS)
-        {
-            uint8_t led_value = ch & 0x03;
-            currentLedLevel = led_value;
-        }
-        else if ((ch & KEYB_KEY_INHIBIT_MASK) == KEYB_KEY_INHIBIT)
-        {
-            keyInhibit = ch & 0x01 == 0;
-        }
-        else if ((ch & KEYB_REPEAT_MASK) == KEYB_REPEAT_DELAY)
-        {
-            uint16_t delayMS = 200 + (ch & 0x0f) * 100;
-            keyRepeatDelay = delayMS;
-        }
-        else if ((ch & KEYB_REPEAT_MASK) == KEYB_REPEAT_INTERVAL)
-        {
-            uint16_t v = (ch & 0x0f);
-            uint16_t intervalMS = 30 + v * v * 5;
-            keyRepeatInterval = intervalMS;
-        }
-        else if ((ch & KEYB_LED_CTRL_MASK) == KEYB_LED_CTRL_MASK)
-        {
-            uint8_t led = ch & 0x7f;
-            currentLedState = led;
-        }
+        uint32_t data = uart_get_hw(KEYB_UART)->dr;
+        if (!(data & (UART_UARTDR_FE_BITS | UART_UARTDR_PE_BITS | UART_UARTDR_BE_BITS)))
+            x68kCommand(data & 0xff);
     }
 }
 
-typedef struct 
+#if MOUSE_TX_DMA
+static int mouseDmaChannel = -1;
+static MouseData mouseTxPacket;
+#endif
+
+static void setupMouseDMA()
 {
-    union
-    {
-        uint8_t data[3];
-        struct
-        {
-            union
-            {
-                struct
-                {
-                    uint8_t Lbtn:1;
-                    uint8_t Rbtn:1;
-                    uint8_t unused:2;
-                    uint8_t Xover:1;
-                    uint8_t Xundr:1;
-                    uint8_t Yover:1;
-                    uint8_t Yundr:1;
-                };
-                uint8_t state;
-            };
-            int8_t  dx;
-            int8_t  dy;
-        };
-    };
-    
-} MouseData;
-
-static void sendMouse()
-{
-    if (txInhibit)
+#if MOUSE_TX_DMA
+    mouseDmaChannel = dma_claim_unused_channel(true);
+
+    dma_channel_config config = dma_channel_get_default_config(mouseDmaChannel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, uart_get_dreq(MOUSE_UART, true));
+
+    dma_channel_configure(mouseDmaChannel, &config,
+                          &uart_get_hw(MOUSE_UART)->dr,
+                          mouseTxPacket.data, sizeof(mouseTxPacket),
+                          false);
+#endif
+}
+
+static void __not_in_flash_func(sendMouse)()
+{
+#if MOUSE_TX_DMA
+    // Previous packet still going out; keep accumulating until the next poll
+    if (dma_channel_is_busy(mouseDmaChannel))
         return;
+#endif
 
-    MouseData mdata =
-    {
-        .Lbtn  = lmbPressed,
-        .Rbtn  = rmbPressed,
-        .Xover = dx > 127,
-        .Xundr = dx <-128,
-        .Yover = dy > 127,
-        .Yundr = dy <-128,
-        .dx = dx & 0xff,
-        .dy = dy & 0xff,
-    };
+    MouseData mdata;
+    if (!x68kMousePacket(&mdata))
+        return;
 
+#if MOUSE_TX_DMA
+    // Latch the snapshot and let the DMA pace it into the UART FIFO
+    mouseTxPacket = mdata;
+    dma_channel_transfer_from_buffer_now(mouseDmaChannel, mouseTxPacket.data, sizeof(mouseTxPacket));
+#else
     uart_write_blocking(MOUSE_UART, mdata.data, sizeof(mdata));
-
-    // Reset mouse readings
-    dx = 0;
-    dy = 0;
+#endif
+    mouseBytesSent += sizeof(mdata);
 
     // Early-out if packet was empty
-    if (mdata.data[0] == mdata.data[1] == mdata.data[2] == 0x00)
+    if ((mdata.data[0] | mdata.data[1] | mdata.data[2]) == 0x00)
         return;
 
-    flashActivityLED(100);
+    activitySeen = true;
 }
 
-static uint8_t modifierScans[] =
+// Key repeat runs off a hardware alarm, so the cadence doesn't depend on the main loop
+
+static int64_t __not_in_flash_func(keyRepeatCallback)(alarm_id_t id, void* userData)
 {
-    0x71, // "CTRL"  = KEYBOARD_MODIFIER_LEFTCTRL
-    0x70, // "SHIFT" = KEYBOARD_MODIFIER_LEFTSHIFT
-    0x56, // "XF2"   = KEYBOARD_MODIFIER_LEFTALT
-    0x55, // "XF1"   = KEYBOARD_MODIFIER_LEFTGUI
-    0x59, // "XF5"   = KEYBOARD_MODIFIER_RIGHTCTRL
-    0x70, // "SHIFT" = KEYBOARD_MODIFIER_RIGHTSHIFT
-    0x57, // "XF3"   = KEYBOARD_MODIFIER_RIGHTALT
-    0x58, // "XF4"   = KEYBOARD_MODIFIER_RIGHTGUI
-};
+    uint32_t next = keyRepeatTick();
 
-static uint8_t keycodeScans[] =
-{
-    0x1e,    // "A"         = HID_KEY_A
-    0x2e,    // "B"         = HID_KEY_B
-    0x2c,    // "C"         = HID_KEY_C
-    0x20,    // "D"         = HID_KEY_D
-    0x13,    // "E"         = HID_KEY_E
-    0x21,    // "F"         = HID_KEY_F
-    0x22,    // "G"         = HID_KEY_G
-    0x23,    // "H"         = HID_KEY_H
-    0x18,    // "I"         = HID_KEY_I
-    0x24,    // "J"         = HID_KEY_J
-    0x25,    // "K"         = HID_KEY_K
-    0x26,    // "L"         = HID_KEY_L
-    0x30,    // "M"         = HID_KEY_M
-    0x2f,    // "N"         = HID_KEY_N
-    0x19,    // "O"         = HID_KEY_O
-    0x1a,    // "P"         = HID_KEY_P
-    0x11,    // "Q"         = HID_KEY_Q
-    0x14,    // "R"         = HID_KEY_R
-    0x1f,    // "S"         = HID_KEY_S
-    0x15,    // "T"         = HID_KEY_T
-    0x17,    // "U"         = HID_KEY_U
-    0x2d,    // "V"         = HID_KEY_V
-    0x12,    // "W"         = HID_KEY_W
-    0x2b,    // "X"         = HID_KEY_X
-    0x16,    // "Y"         = HID_KEY_Y
-    0x2a,    // "Z"         = HID_KEY_Z
-    0x02,    // "1"         = HID_KEY_1
-    0x03,    // "2"         = HID_KEY_2
-    0x04,    // "3"         = HID_KEY_3
-    0x05,    // "4"         = HID_KEY_4
-    0x06,    // "5"         = HID_KEY_5
-    0x07,    // "6"         = HID_KEY_6
-    0x08,    // "7"         = HID_KEY_7
-    0x09,    // "8"         = HID_KEY_8
-    0x0a,    // "9"         = HID_KEY_9
-    0x0b,    // "0"         = HID_KEY_0
-    0x1d,    // "RETURN"    = HID_KEY_ENTER
-    0x01,    // "ESC"       = HID_KEY_ESCAPE
-    0x0f,    // "BS"        = HID_KEY_BACKSPACE
-    0x10,    // "TAB"       = HID_KEY_TAB
-    0x35,    // "SPACE"     = HID_KEY_SPACE
-    0x0c,    // "-"         = HID_KEY_MINUS
-    0x0d,    // "^"         = HID_KEY_EQUAL
-    0x1b,    // "@"         = HID_KEY_BRACKET_LEFT
-    0x1c,    // "["         = HID_KEY_BRACKET_RIGHT
-    0x0e,    // "YEN"       = HID_KEY_BACKSLASH
-    0x29,    // "]"         = HID_KEY_EUROPE_1
-    0x27,    // ";"         = HID_KEY_SEMICOLON
-    0x28,    // ":"         = HID_KEY_APOSTROPHE
-    0x60,    //"ZENKAKU"    = HID_KEY_GRAVE
-    0x31,    // < ,         = HID_KEY_COMMA
-    0x32,    // > .         = HID_KEY_PERIOD
-    0x33,    // ? /         = HID_KEY_SLASH
-    0x5d,    // "CAPS"      = HID_KEY_CAPS_LOCK
-    0x63,    // "F1"        = HID_KEY_F1
-    0x64,    // "F2"        = HID_KEY_F2
-    0x65,    // "F3"        = HID_KEY_F3
-    0x66,    // "F4"        = HID_KEY_F4
-    0x67,    // "F5"        = HID_KEY_F5
-    0x68,    // "F6"        = HID_KEY_F6
-    0x69,    // "F7"        = HID_KEY_F7
-    0x6a,    // "F8"        = HID_KEY_F8
-    0x6b,    // "F9"        = HID_KEY_F9
-    0x6c,    // "F10"       = HID_KEY_F10
-    0x5a,    // "KANA"      = HID_KEY_F11               (0x72 ?= "OPT.1")
-    0x5b,    // "LATIN"     = HID_KEY_F12               (0x73 ?= "OPT.2")
-    0x62,    // "COPY"      = HID_KEY_PRINT_SCREEN
-    0x54,    // "HELP"      = HID_KEY_SCROLL_LOCK
-    0x61,    // "BREAK"     = HID_KEY_PAUSE
-    0x5e,    // "INS"       = HID_KEY_INSERT
-    0x36,    // "HOME"      = HID_KEY_HOME
-    0x38,    // "ROLL UP"   = HID_KEY_PAGE_UP
-    0x37,    // "DEL"       = HID_KEY_DELETE
-    0x3a,    // "UNDO"      = HID_KEY_END
-    0x39,    // "ROLL DOWN" = HID_KEY_PAGE_DOWN
-    0x3d,    // "RIGHT"     = HID_KEY_ARROW_RIGHT
-    0x3b,    // "LEFT"      = HID_KEY_ARROW_LEFT
-    0x3e,    // "DOWN"      = HID_KEY_ARROW_DOWN
-    0x3c,    // "UP"        = HID_KEY_ARROW_UP
-    0x3f,    // "CLR"       = HID_KEY_NUM_LOCK
-    0x40,    // "/"         = HID_KEY_KEYPAD_DIVIDE      (0x52 ?= "SYMBOL INPUT")
-    0x41,    // "*"         = HID_KEY_KEYPAD_MULTIPLY    (0x53 ?= "TOROKU")
-    0x42,    // "-"         = HID_KEY_KEYPAD_SUBTRACT    (0x5c ?= "CODE INPUT")
-    0x46,    // "+"         = HID_KEY_KEYPAD_ADD
-    0x4e,    // "ENTER"     = HID_KEY_KEYPAD_ENTER
-    0x4b,    // "1"         = HID_KEY_KEYPAD_1
-    0x4c,    // "2"         = HID_KEY_KEYPAD_2
-    0x4d,    // "3"         = HID_KEY_KEYPAD_3
-    0x47,    // "4"         = HID_KEY_KEYPAD_4
-    0x48,    // "5"         = HID_KEY_KEYPAD_5
-    0x49,    // "6"         = HID_KEY_KEYPAD_6
-    0x43,    // "7"         = HID_KEY_KEYPAD_7
-    0x44,    // "8"         = HID_KEY_KEYPAD_8
-    0x45,    // "9"         = HID_KEY_KEYPAD_9
-    0x4f,    // "0"         = HID_KEY_KEYPAD_0
-    0x51,    // "."         = HID_KEY_KEYPAD_DECIMAL
-    0x0e,    // "YEN"       = HID_KEY_EUROPE_2
-};
+    // Negative means relative to the previous deadline, so latency doesn't accumulate
+    return next ? -(int64_t)next : 0;
+}
+
+#if MOUSE_PREDICT
+static alarm_id_t mousePrebuildAlarm = 0;
 
-static void sendKeycode(uint8_t keyCode, bool make)
+// Just ahead of the next expected MSCTRL edge
+static int64_t __not_in_flash_func(mousePrebuildCallback)(alarm_id_t id, void* userData)
 {
-    if (keyCode < HID_KEY_A || (keyCode - HID_KEY_A) >= sizeof(keycodeScans))
-        return;
+    mousePrebuildAlarm = 0;
+    x68kMousePrebuild();
+    return 0;
+}
+#endif
 
-    uint8_t scan = keycodeScans[keyCode - HID_KEY_A];
-    scan |= (make ? 0x00 : 0x80);
-    uart_write_blocking(KEYB_UART, &scan, sizeof(scan));
+static alarm_id_t macroAlarm         = 0;
 
-    flashActivityLED(100);
+static int64_t __not_in_flash_func(macroCallback)(alarm_id_t id, void* userData)
+{
+    // The macro deadlines are absolute, so this counts from now
+    uint32_t next = keyMacroTick();
+    if (!next)
+        macroAlarm = 0;
+    return next;
 }
 
-static bool isPresentInReport(hid_keyboard_report_t const *report, uint8_t keyCode)
+static void setupKeyRepeat()
 {
-    for (int i = 0; i < sizeof(report->keycode); ++i)
-    {
-        if (report->keycode[i] == keyCode)
-            return true;
-    }
-    return false;
+    // Alarm callbacks run on the core that created the pool, i.e. the X68000 side
+    x68kAlarmPool = alarm_pool_create_with_unused_hardware_alarm(4);
 }
 
-static void compareKeybReports(hid_keyboard_report_t const* reportA, hid_keyboard_report_t const* reportB, bool make)
+// Hooks for x68k_link.c
+
+void __not_in_flash_func(x68kKeybTxKick)(void)
 {
-    for (int i = 0; i < sizeof(reportA->keycode); ++i)
-    {
-        uint8_t keyCode = reportA->keycode[i];
-
-        // Skip ErrorRollOver, POSTFail & ErrorUndefined
-        if (keyCode == HID_KEY_NONE || keyCode <= 0x03)
-            continue;
-
-        if (!isPresentInReport(reportB, keyCode))
-        {
-            sendKeycode(keyCode, make);
-
-            // Record the most recent KEYDOWN, or reset it
-            if (make)
-            {
-                keyRepeatKeyCode = keyCode;
-                keyRepeatCountdown = keyRepeatDelay;
-            }
-            else
-            {
-                if (keyRepeatKeyCode == keyCode)
-                {
-                    keyRepeatKeyCode = 0;
-                    keyRepeatCountdown = 0;
-                }
-            }
-        }
-    }
+    keybTxKick();
+}
+
+void __not_in_flash_func(x68kSendMouse)(void)
+{
+    sendMouse();
+}
+
+void __not_in_flash_func(x68kStartRepeatTimer)(uint32_t delayUs)
+{
+    keyRepeatAlarm = alarm_pool_add_alarm_in_us(x68kAlarmPool, delayUs, keyRepeatCallback, NULL, true);
+}
+
+void __not_in_flash_func(x68kStopRepeatTimer)(void)
+{
+    if (keyRepeatAlarm > 0)
+        alarm_pool_cancel_alarm(x68kAlarmPool, keyRepeatAlarm);
+
+    keyRepeatAlarm = 0;
+}
+
+void __not_in_flash_func(x68kStartMacroTimer)(uint32_t delayUs)
+{
+    if (macroAlarm > 0)
+        alarm_pool_cancel_alarm(x68kAlarmPool, macroAlarm);
+
+    macroAlarm = alarm_pool_add_alarm_in_us(x68kAlarmPool, delayUs, macroCallback, NULL, true);
+}
+
+#if MOUSE_PREDICT
+void __not_in_flash_func(x68kStartMouseTimer)(uint32_t delayUs)
+{
+    if (mousePrebuildAlarm > 0)
+        alarm_pool_cancel_alarm(x68kAlarmPool, mousePrebuildAlarm);
+
+    mousePrebuildAlarm = alarm_pool_add_alarm_in_us(x68kAlarmPool, delayUs, mousePrebuildCallback, NULL, true);
+}
+#endif
+
+void __not_in_flash_func(x68kActivity)(void)
+{
+    activitySeen = true;
+}
+
+// %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+//
+// Config store
+//
+
+// Anything on the lines right now: a byte coming in (the start bit is low) or going out, or
+// MSCTRL held low
+static bool x68kLinesBusy()
+{
+    return !gpio_get(KEYB_UART_RX) || !gpio_get(MSCTRL_GPIO) ||
+           (uart_get_hw(KEYB_UART)->fr & UART_UARTFR_BUSY_BITS) ||
+           (uart_get_hw(MOUSE_UART)->fr & UART_UARTFR_BUSY_BITS);
 }
 
-static void processKeybAndMouse(uint32_t deltaTime)
+// Every CONFIG_CHECK_MS, from the config task
+static void saveConfigWhenIdle(bool busy)
 {
-    // This should really be done via ISR, but the UART IRQ is limited to >=4 chars, or 32 bitclocks
-    if (1)
+    uint32_t currentTimer = board_millis();
+    bool idle = !busy && (currentTimer - lastReportMs) >= CONFIG_IDLE_MS;
+
+    // configSave() ignores it if nothing changed
+    X68kConfig config = *configLoad();
+    x68kStoreConfig(&config);
+    configSave(&config);
+
+    configService(idle, x68kLinesBusy() ? 0 : x68kLinkQuietUs());
+}
+
+// %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+//
+// Counters
+//
+
+// On the dump chord. Like the stats, read without locking.
+static void dumpCounters()
+{
+    static uint32_t lastDumped = 0;
+    static uint32_t lastMsctrlRequests = 0;
+
+    uint32_t currentTimer = board_millis();
+    uint32_t elapsed = currentTimer - lastDumped;
+    uint32_t msctrlRequests = x68kCounters.msctrlRequests;
+    uint32_t msctrlPerSecond = elapsed ? (uint64_t)(msctrlRequests - lastMsctrlRequests) * 1000 / elapsed : 0;
+    lastDumped = currentTimer;
+    lastMsctrlRequests = msctrlRequests;
+
+#if TELEMETRY
+    uint8_t data[TELEMETRY_MAX_DATA];
+    uint8_t* out = telemetryPut32(data, msctrlPerSecond);
+    out = telemetryPut32(out, keybBytesSent);
+    out = telemetryPut32(out, mouseBytesSent);
+    out = telemetryPut32(out, x68kCounters.keybQueueHighWater);
+    out = telemetryPut32(out, inputEvents.highWater);
+    out = telemetryPut32(out, inputEvents.keyOverflows);
+    out = telemetryPut32(out, inputEvents.mouseOverflows);
+    out = telemetryPut32(out, x68kCounters.repeatsDropped);
+    out = telemetryPut32(out, x68kCounters.txInhibitUs);
+    out = telemetryPut32(out, tuhTaskMaxUs);
+    out = telemetryPut32(out, loopMaxUs);
+    out = telemetryPut32(out, x68kCounters.macroStalls);
+    out = telemetryPut32(out, x68kCounters.macrosDropped);
+    out = telemetryPut32(out, x68kCounters.msctrlDeferred);
+    telemetryWrite(TELEMETRY_PERF, currentTimer, data, out - data);
+
+    out = data;
+    for (int d = 0; d < HID_MAX_DEVICES; ++d)
+        out = telemetryPut32(out, reportsReceived[d]);
+    telemetryWrite(TELEMETRY_REPORTS, currentTimer, data, out - data);
+
+    for (uint8_t i = 0; i < mainScheduler.count; ++i)
     {
-        bool wasAserted = msctrlAsserted;
-        uartISR();
-        bool isAsserted = msctrlAsserted;
-        if (!wasAserted && isAsserted)
-            sendMouse();
+        SchedulerTask const* task = &mainTasks[i];
+        out = telemetryPut8(data, i);
+        out = telemetryPut32(out, task->runs);
+        out = telemetryPut32(out, task->maxUs);
+        out = telemetryPut32(out, task->maxLateUs);
+        for (char const* name = task->name; *name && out < data + TELEMETRY_TASK_MAX_DATA; ++name)
+            out = telemetryPut8(out, *name);
+        telemetryWrite(TELEMETRY_TASK, currentTimer, data, out - data);
     }
-
-    // Handle key repeats
-    if (keyRepeatCountdown)
+#else
+    printf("counters @ %lu ms\n", (unsigned long)currentTimer);
+    printf("msctrl %lu/s, keyb %lu bytes, mouse %lu bytes\n", (unsigned long)msctrlPerSecond,
+           (unsigned long)keybBytesSent, (unsigned long)mouseBytesSent);
+    printf("keyb queue max %lu, event ring max %lu, overflows %lu key / %lu mouse, repeats dropped %lu\n",
+           (unsigned long)x68kCounters.keybQueueHighWater, (unsigned long)inputEvents.highWater,
+           (unsigned long)inputEvents.keyOverflows, (unsigned long)inputEvents.mouseOverflows,
+           (unsigned long)x68kCounters.repeatsDropped);
+    printf("ready stalls %lu us, tuh_task max %lu us, loop max %lu us\n", (unsigned long)x68kCounters.txInhibitUs,
+           (unsigned long)tuhTaskMaxUs, (unsigned long)loopMaxUs);
+    printf("macro stalls %lu, macros dropped %lu, mouse polls deferred %lu\n", (unsigned long)x68kCounters.macroStalls,
+           (unsigned long)x68kCounters.macrosDropped, (unsigned long)x68kCounters.msctrlDeferred);
+    for (int d = 0; d < HID_MAX_DEVICES; ++d)
     {
-        keyRepeatCountdown -= deltaTime;
-        if (keyRepeatCountdown <= 0)
-        {
-            // send repeat
-            sendKeycode(keyRepeatKeyCode, true);
-            keyRepeatCountdown = keyRepeatInterval;
-        }
+        if (reportsReceived[d])
+            printf("device %d: %lu reports\n", d, (unsigned long)reportsReceived[d]);
     }
+    for (uint8_t i = 0; i < mainScheduler.count; ++i)
+    {
+        SchedulerTask const* task = &mainTasks[i];
+        printf("task %s: %lu runs, max %lu us, late max %lu us\n", task->name, (unsigned long)task->runs,
+               (unsigned long)task->maxUs, (unsigned long)task->maxLateUs);
+    }
+#endif
+
+    tuhTaskMaxUs = 0;
+    loopMaxUs = 0;
+    schedulerResetStats(&mainScheduler);
 }
 
-static void processKeybReport(hid_keyboard_report_t const *report)
+#if LATENCY_STATS || TELEMETRY
+// %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+//
+// Stats
+//
+
+#if TELEMETRY
+#if LATENCY_STATS
+static void sendLatency(uint8_t id, LatencyHistogram const* histogram, uint32_t timestamp)
 {
-    // Evaluate modifiers (SHIFT/CTRL/ALT/GUI)
-    uint8_t modified = prevReport.modifier ^ report->modifier;
-    if (modified)
-    {
-        for (int i = 0; i < 8; ++i)
-        {
-            hid_keyboard_modifier_bm_t mod = 1 << i;
-            if (modified & mod)
-            {
-                bool make = report->modifier & mod;
-                uint8_t scan = modifierScans[i] | (make ? 0x00 : 0x80);
-                uart_write_blocking(KEYB_UART, &scan, sizeof(scan));
-
-                flashActivityLED(100);
-            }
-        }
-    }
+    uint8_t data[21];
+    uint8_t* out = telemetryPut8(data, id);
+    out = telemetryPut32(out, histogram->count);
+    out = telemetryPut32(out, histogram->count ? histogram->min : 0);
+    out = telemetryPut32(out, histogram->count ? (uint32_t)(histogram->sum / histogram->count) : 0);
+    out = telemetryPut32(out, latencyPercentile(histogram, 99));
+    out = telemetryPut32(out, histogram->max);
+    telemetryWrite(TELEMETRY_LATENCY, timestamp, data, out - data);
+}
+#endif
+
+static void sendCounters(uint32_t timestamp)
+{
+    uint8_t data[20];
+    uint8_t* out = telemetryPut32(data, inputEvents.keyOverflows);
+    out = telemetryPut32(out, inputEvents.mouseOverflows);
+#if HID_CAPTURE
+    out = telemetryPut32(out, hidCaptureDropped());
+#else
+    out = telemetryPut32(out, 0);
+#endif
+    out = telemetryPut32(out, telemetryDropped());
+#if MOUSE_PREDICT
+    out = telemetryPut32(out, x68kMsctrlPeriod());
+#else
+    out = telemetryPut32(out, 0);
+#endif
+    telemetryWrite(TELEMETRY_COUNTERS, timestamp, data, out - data);
+}
+#endif
 
-    // evaluate BREAK codes (key-up)
-    compareKeybReports(&prevReport, report, false);
+// Every LATENCY_DUMP_MS, from the stats task on core0; the histograms are snapshotted
+// without locking, which is fine for stats
+static void dumpStats()
+{
+    uint32_t currentTimer = board_millis();
+
+#if TELEMETRY
+    sendCounters(currentTimer);
+#if LATENCY_STATS
+    sendLatency(TELEMETRY_LATENCY_KEY_QUEUE, &latencyKeyQueue, currentTimer);
+    sendLatency(TELEMETRY_LATENCY_KEY_SEND, &latencyKeySend, currentTimer);
+    sendLatency(TELEMETRY_LATENCY_MOUSE_SEND, &latencyMouseSend, currentTimer);
+    sendLatency(TELEMETRY_LATENCY_MSCTRL, &latencyMsctrl, currentTimer);
+    sendLatency(TELEMETRY_LATENCY_MSCTRL_POLL, &latencyMsctrlPoll, currentTimer);
+#endif
+#else
+    printf("latency @ %lu ms\n", (unsigned long)currentTimer);
+    latencyPrint("key-queue", &latencyKeyQueue);
+    latencyPrint("key-send", &latencyKeySend);
+    latencyPrint("mouse-send", &latencyMouseSend);
+    latencyPrint("msctrl", &latencyMsctrl);
+    latencyPrint("msctrl-poll", &latencyMsctrlPoll);
+#if MOUSE_PREDICT
+    printf("msctrl-period %lu us\n", (unsigned long)x68kMsctrlPeriod());
+#endif
+#endif
+}
+#endif
 
-    // evaluate MAKE codes (key-down)
-    compareKeybReports(report, &prevReport, true);
+#if HID_CAPTURE
+// %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+//
+// HID capture
+//
 
-    prevReport = *report;
+static char captureRttBuffer[HID_CAPTURE_RTT_BUFFER_SIZE];
+
+static void setupHidCapture()
+{
+    // Skip mode: a write either goes in whole or not at all, it never waits for the debugger
+    SEGGER_RTT_ConfigUpBuffer(HID_CAPTURE_RTT_CHANNEL, "x68k-capture", captureRttBuffer, sizeof(captureRttBuffer),
+                              SEGGER_RTT_MODE_NO_BLOCK_SKIP);
 }
 
-static void processMouseReport(hid_mouse_report_t const * report)
+// Whole records only, so the stream stays in step with its framing. One that doesn't fit in
+// the RTT buffer yet stays in the capture ring for the next pass.
+// Returns true if there is more to send
+static bool drainHidCapture()
 {
-    lmbPressed = report->buttons & MOUSE_BUTTON_LEFT;
-    rmbPressed = report->buttons & MOUSE_BUTTON_RIGHT;
-    dx += report->x;
-    dy += report->y;
+    static uint8_t record[HID_CAPTURE_MAX_RECORD];
+    uint32_t sent = 0;
+    uint32_t size;
+
+    while ((size = hidCaptureNext(record)) != 0 && sent < HID_CAPTURE_DRAIN)
+    {
+        if (SEGGER_RTT_Write(HID_CAPTURE_RTT_CHANNEL, record, size) != size)
+            break;
+
+        hidCaptureConsume(size);
+        sent += size;
+    }
+    return size != 0;
 }
+#endif
@@ -0,0 +1,62 @@
+#include "scheduler.h"
+
+void schedulerStart(Scheduler* scheduler)
+{
+    uint32_t now = scheduler->now();
+    for (uint8_t i = 0; i < scheduler->count; ++i)
+        scheduler->tasks[i].nextDue = now;
+}
+
+uint32_t schedulerRun(Scheduler* scheduler)
+{
+    uint32_t untilNext = UINT32_MAX;
+
+    for (uint8_t i = 0; i < scheduler->count; ++i)
+    {
+        SchedulerTask* task = &scheduler->tasks[i];
+        uint32_t start = scheduler->now();
+
+        if (task->periodUs)
+        {
+            int32_t late = (int32_t)(start - task->nextDue);
+            if (late < 0)
+            {
+                if ((uint32_t)-late < untilNext)
+                    untilNext = -late;
+                continue;
+            }
+
+            if ((uint32_t)late > task->maxLateUs)
+                task->maxLateUs = late;
+
+            // The next deadline on the original grid, past the ones already missed
+            task->nextDue += task->periodUs * ((uint32_t)late / task->periodUs + 1);
+        }
+
+        task->run();
+
+        uint32_t end = scheduler->now();
+        uint32_t runUs = end - start;
+        if (runUs > task->maxUs)
+            task->maxUs = runUs;
+        ++task->runs;
+
+        if (task->periodUs)
+        {
+            uint32_t untilDue = (int32_t)(task->nextDue - end) > 0 ? task->nextDue - end : 0;
+            if (untilDue < untilNext)
+                untilNext = untilDue;
+        }
+    }
+
+    return untilNext;
+}
+
+void schedulerResetStats(Scheduler* scheduler)
+{
+    for (uint8_t i = 0; i < scheduler->count; ++i)
+    {
+        scheduler->tasks[i].maxUs = 0;
+        scheduler->tasks[i].maxLateUs = 0;
+    }
+}
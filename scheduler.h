@@ -0,0 +1,44 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Cooperative scheduler for the core0 main loop. Tasks run to completion, in table order,
+// which is their priority: a pass runs every task that's due once, highest first, so the
+// X68000 link and USB never wait behind cosmetic work and nothing low priority is starved.
+// A task with a period is due at fixed deadlines (missed ones are skipped, not bunched up),
+// one without runs every pass. Runtimes are tracked per task.
+
+typedef struct
+{
+    char const* name;
+    void (*run)(void);
+    uint32_t periodUs;          // 0 = every pass
+
+    uint32_t nextDue;
+    uint32_t runs;
+    uint32_t maxUs;             // longest run, since schedulerResetStats()
+    uint32_t maxLateUs;         // furthest past its deadline at start, likewise
+} SchedulerTask;
+
+#define SCHEDULER_TASK(name, run, periodUs)     { name, run, periodUs, 0, 0, 0, 0 }
+
+typedef struct
+{
+    SchedulerTask* tasks;
+    uint8_t count;
+    uint32_t (*now)(void);      // us, free running
+} Scheduler;
+
+// Makes every task due at the first pass
+void schedulerStart(Scheduler* scheduler);
+
+// One pass over the table. Returns the time until the next deadline (us), UINT32_MAX without
+// periodic tasks. The every-pass ones are meant for event driven work, so the caller can
+// sleep until then or until an interrupt, whichever is first.
+uint32_t schedulerRun(Scheduler* scheduler);
+
+void schedulerResetStats(Scheduler* scheduler);
+
+#endif
@@ -0,0 +1,43 @@
+#include <string.h>
+#include "SEGGER_RTT.h"
+
+#include "telemetry.h"
+
+static char telemetryBuffer[TELEMETRY_BUFFER_SIZE];
+static uint32_t telemetryDrops      = 0;
+
+void telemetryInit(void)
+{
+    // Skip mode: a write either goes in whole or not at all, it never waits for the debugger
+    SEGGER_RTT_ConfigUpBuffer(TELEMETRY_RTT_CHANNEL, "x68k-telemetry", telemetryBuffer, sizeof(telemetryBuffer),
+                              SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+
+    static uint8_t const header[] = { 'X', '6', 'T', 'M', TELEMETRY_VERSION };
+    SEGGER_RTT_WriteNoLock(TELEMETRY_RTT_CHANNEL, header, sizeof(header));
+}
+
+bool telemetryWrite(uint8_t type, uint32_t timestamp, uint8_t const* data, uint8_t len)
+{
+    if (len > TELEMETRY_MAX_DATA)
+        return false;
+
+    uint8_t record[TELEMETRY_HEADER_SIZE + TELEMETRY_MAX_DATA];
+    uint8_t* out = telemetryPut8(record, type);
+    out = telemetryPut8(out, len);
+    out = telemetryPut32(out, timestamp);
+    memcpy(out, data, len);
+
+    // Only ever written from one context, and the other channels have their own buffers
+    uint32_t size = TELEMETRY_HEADER_SIZE + len;
+    if (SEGGER_RTT_WriteNoLock(TELEMETRY_RTT_CHANNEL, record, size) != size)
+    {
+        ++telemetryDrops;
+        return false;
+    }
+    return true;
+}
+
+uint32_t telemetryDropped(void)
+{
+    return telemetryDrops;
+}
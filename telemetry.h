@@ -0,0 +1,85 @@
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Binary telemetry on its own RTT up-channel, next to stdio on channel 0. Both UARTs belong
+// to the X68000 link, so nothing here can get into the keyboard or mouse streams, and a write
+// never waits: a record that doesn't fit in the RTT buffer is dropped whole and counted.
+// Decode with host/telemetry.c.
+//
+// Stream format, little endian:
+//   "X6TM" TELEMETRY_VERSION
+//   then one record per event:
+//     uint8  type          TELEMETRY_xxx
+//     uint8  len           of data[]
+//     uint32 timestamp     board_millis()
+//     uint8  data[len]
+
+#define TELEMETRY_MAGIC             "X6TM"
+#define TELEMETRY_VERSION           1
+
+#define TELEMETRY_HEADER_SIZE       6
+#define TELEMETRY_MAX_DATA          64
+
+// uint8 id (TELEMETRY_LATENCY_xxx), uint32 count, min, avg, p99, max (us)
+#define TELEMETRY_LATENCY           1
+// uint32 key overflows, mouse overflows, capture drops, telemetry drops; uint32 MSCTRL period (us)
+#define TELEMETRY_COUNTERS          2
+// uint8 devAddr, instance, itfProtocol, poll interval (ms), device's own interval (ms)
+#define TELEMETRY_MOUNT             3
+// uint8 devAddr, instance
+#define TELEMETRY_UMOUNT            4
+// On the dump chord: uint32 MSCTRL requests per second, keyboard bytes sent, mouse bytes sent,
+// keyboard queue high-water, event ring high-water, key overflows, mouse overflows, repeats
+// dropped, READY stall time (us), tuh_task() max (us), main loop max (us), macro stalls,
+// macros dropped, mouse polls deferred by READY; the maxima are since the previous dump.
+// Fields are only ever added at the end.
+#define TELEMETRY_PERF              5
+// On the dump chord: uint32 reports received, per device address
+#define TELEMETRY_REPORTS           6
+// On the dump chord, one per core0 task (see scheduler.h): uint8 index, uint32 runs, longest
+// run (us), furthest past its deadline (us), since the previous dump; then the name
+#define TELEMETRY_TASK              7
+#define TELEMETRY_TASK_MAX_DATA     29
+
+#define TELEMETRY_LATENCY_KEY_QUEUE     0
+#define TELEMETRY_LATENCY_KEY_SEND      1
+#define TELEMETRY_LATENCY_MOUSE_SEND    2
+#define TELEMETRY_LATENCY_MSCTRL        3
+#define TELEMETRY_LATENCY_MSCTRL_POLL   4
+
+#ifndef TELEMETRY_RTT_CHANNEL
+#define TELEMETRY_RTT_CHANNEL       1
+#endif
+
+#ifndef TELEMETRY_BUFFER_SIZE
+#define TELEMETRY_BUFFER_SIZE       2048
+#endif
+
+// Sets up the RTT channel and writes the stream header
+void telemetryInit(void);
+
+// From one context only (the core0 main loop). Returns false if the record was dropped.
+bool telemetryWrite(uint8_t type, uint32_t timestamp, uint8_t const* data, uint8_t len);
+
+uint32_t telemetryDropped(void);
+
+// Little endian helpers for building data[]; return the position after the value
+static inline uint8_t* telemetryPut8(uint8_t* out, uint8_t value)
+{
+    *out = value;
+    return out + 1;
+}
+
+static inline uint8_t* telemetryPut32(uint8_t* out, uint32_t value)
+{
+    out[0] = value & 0xff;
+    out[1] = (value >> 8) & 0xff;
+    out[2] = (value >> 16) & 0xff;
+    out[3] = value >> 24;
+    return out + 4;
+}
+
+#endif
@@ -5,7 +5,22 @@
 #define CFG_TUSB_DEBUG_PRINTF tuh_printf
 
 #define CFG_TUSB_MCU               OPT_MCU_RP2040
+
+// Host on the native USB controller (0), or on Pico-PIO-USB (1). TinyUSB can't drive both
+// host controllers at once, so with PIO-USB both root ports are PIO ones (see main.c) and
+// the native port is left unused.
+#ifndef X68K_PIO_USB
+#define X68K_PIO_USB               0
+#endif
+
+#if X68K_PIO_USB
+#define CFG_TUH_RPI_PIO_USB        1
+#define CFG_TUSB_RHPORT1_MODE      OPT_MODE_HOST
+#define BOARD_TUH_RHPORT           1
+#else
 #define CFG_TUSB_RHPORT0_MODE      OPT_MODE_HOST
+#define BOARD_TUH_RHPORT           0
+#endif
 
 #define CFG_TUH_HUB                 1
 #define CFG_TUH_DEVICE_MAX          (3*CFG_TUH_HUB + 1)
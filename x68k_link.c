@@ -0,0 +1,790 @@
+#include <stdlib.h>
+
+#include "x68k_platform.h"
+#include "event_ring.h"
+#include "hid_translate.h"
+#include "x68k_link.h"
+#include "config.h"
+#include "macro.h"
+
+// Everything here runs in IRQ context or right before it (MSCTRL, the keyboard line, key
+// repeat), so it's all kept in RAM, see PLATFORM_RAM_FUNC
+
+#define MOUSE_BUTTON_LEFT           0x01
+#define MOUSE_BUTTON_RIGHT          0x02
+
+// x68000 state
+static bool txInhibit               = false;
+static bool keyInhibit              = false;
+static bool msctrlAsserted          = false;
+static bool mouseOwed               = false;    // MSCTRL came while READY was off
+static volatile uint32_t lastCommandUs  = 0;    // or MSCTRL request
+
+static uint8_t currentLedLevel      = 0;
+static volatile uint8_t currentLedState = 0x7f; // active low, all off until the X68000 sets them
+
+static uint16_t keyRepeatDelay      = 500; // ms
+static uint16_t keyRepeatInterval   = 110; // ms
+static uint16_t mouseScale          = MOUSE_SCALE;
+
+// USB HID state
+static int32_t dx = 0, dy = 0;   // not yet sent, in X68000 counts
+static bool lmbPressed              = false;
+static bool rmbPressed              = false;
+static volatile uint8_t keyRepeatScan = 0x00;
+
+#if LATENCY_STATS
+LatencyHistogram latencyKeyQueue;
+LatencyHistogram latencyKeySend;
+LatencyHistogram latencyMouseSend;
+LatencyHistogram latencyMsctrl;
+LatencyHistogram latencyMsctrlPoll;
+
+static uint32_t msctrlTimestamp     = 0;    // last MSCTRL request
+static uint32_t mouseTimestamp      = 0;    // oldest HID report not yet sent, if mouseStamped
+static bool mouseStamped            = false;
+#endif
+
+X68kCounters x68kCounters;
+static uint32_t txInhibitStart      = 0;
+
+// Keyboard TX queue - scancodes are queued by the event consumer and the macro timer, and
+// drained by the platform (the UART TX IRQ) one byte at a time, so nothing ever waits on the
+// 2400 baud link. The line only carries ~240 bytes/s, so when it backs up the order is:
+//  - BREAKs first, ahead of queued MAKEs of other keys, so a release is never held up
+//    behind new presses. Not ahead of a MAKE of the same key, and never past a modifier
+//    (SHIFT, CTRL, XF, KANA...), as that would change what the keys around it mean.
+//  - then everything else in order
+//  - then key repeat, which has a slot of its own: a newer repeat replaces one that hasn't
+//    gone out yet, and releasing the key drops it.
+
+#define KEYB_TX_QUEUE_SIZE          64  // must be a power of two <= 256
+#define KEYB_TX_QUEUE_MASK          (KEYB_TX_QUEUE_SIZE - 1)
+
+static uint8_t keybTxQueue[KEYB_TX_QUEUE_SIZE];
+#if LATENCY_STATS
+static uint32_t keybTxTimestamps[KEYB_TX_QUEUE_SIZE];  // HID report time, 0 for repeats
+#endif
+static volatile uint8_t keybTxHead  = 0;   // written by keybTxQueueScan() only
+static volatile uint8_t keybTxTail  = 0;   // written by keybTxPop() only
+static volatile uint8_t keybTxRepeat = 0;  // scancode of a repeat waiting to go out, 0 = none
+
+static uint32_t PLATFORM_RAM_FUNC(keybTxFree)()
+{
+    return KEYB_TX_QUEUE_SIZE - (uint8_t)(keybTxHead - keybTxTail);
+}
+
+static bool PLATFORM_RAM_FUNC(keybTxInhibited)()
+{
+    return txInhibit || keyInhibit;
+}
+
+// Both the event consumer and the key repeat timer queue scancodes, so keep them apart.
+// 'timestamp' is when the HID report came in, or 0 if the scancode doesn't come from one.
+static bool PLATFORM_RAM_FUNC(keybTxQueueScan)(uint8_t scan, uint32_t timestamp)
+{
+    uint32_t status = platformCriticalEnter();
+    bool queued = keybTxFree() != 0;
+    if (queued)
+    {
+        keybTxQueue[keybTxHead & KEYB_TX_QUEUE_MASK] = scan;
+#if LATENCY_STATS
+        keybTxTimestamps[keybTxHead & KEYB_TX_QUEUE_MASK] = timestamp;
+#else
+        (void)timestamp;
+#endif
+        platformCompilerBarrier();
+        keybTxHead = keybTxHead + 1;
+
+        // A repeat sent after the BREAK would leave the key stuck
+        if (scan == (keybTxRepeat | 0x80))
+            keybTxRepeat = 0;
+
+        uint8_t queued = keybTxHead - keybTxTail;
+        if (queued > x68kCounters.keybQueueHighWater)
+            x68kCounters.keybQueueHighWater = queued;
+    }
+    platformCriticalExit(status);
+    return queued;
+}
+
+bool PLATFORM_RAM_FUNC(keybTxPending)(void)
+{
+    return (keybTxHead != keybTxTail || keybTxRepeat) && !keybTxInhibited();
+}
+
+uint32_t x68kLinkQuietUs(void)
+{
+    if (msctrlAsserted || keybTxHead != keybTxTail || keybTxRepeat)
+        return 0;
+    return platformTimeUs() - lastCommandUs;
+}
+
+// Keys that change how the others are read, see above
+static bool PLATFORM_RAM_FUNC(isModifierScan)(uint8_t scan)
+{
+    return (scan >= 0x55 && scan <= 0x60) || (scan >= 0x70 && scan <= 0x73);
+}
+
+// The queue entry to send next: the first BREAK that may go ahead of the ones before it
+static uint8_t PLATFORM_RAM_FUNC(keybTxNext)(void)
+{
+    uint32_t made[4] = { 0 };
+    for (uint8_t i = keybTxTail; i != keybTxHead; ++i)
+    {
+        uint8_t scan = keybTxQueue[i & KEYB_TX_QUEUE_MASK];
+        uint8_t key = scan & 0x7f;
+        if (isModifierScan(key))
+            break;
+
+        uint32_t bit = 1u << (key & 31);
+        if (!(scan & 0x80))
+            made[key >> 5] |= bit;
+        else if (!(made[key >> 5] & bit))
+            return i;
+    }
+    return keybTxTail;
+}
+
+// Must be called from the TX IRQ, or with interrupts disabled
+bool PLATFORM_RAM_FUNC(keybTxPop)(uint8_t* scan)
+{
+    if (!keybTxPending())
+        return false;
+
+    if (keybTxHead == keybTxTail)
+    {
+        *scan = keybTxRepeat;
+        keybTxRepeat = 0;
+        return true;
+    }
+
+    // Take it out, and move the ones it overtook up by one
+    uint8_t next = keybTxNext();
+    *scan = keybTxQueue[next & KEYB_TX_QUEUE_MASK];
+#if LATENCY_STATS
+    uint32_t timestamp = keybTxTimestamps[next & KEYB_TX_QUEUE_MASK];
+    if (timestamp)
+        latencyRecord(&latencyKeySend, platformTimeUs() - timestamp);
+#endif
+    for (uint8_t i = next; i != keybTxTail; --i)
+    {
+        keybTxQueue[i & KEYB_TX_QUEUE_MASK] = keybTxQueue[(uint8_t)(i - 1) & KEYB_TX_QUEUE_MASK];
+#if LATENCY_STATS
+        keybTxTimestamps[i & KEYB_TX_QUEUE_MASK] = keybTxTimestamps[(uint8_t)(i - 1) & KEYB_TX_QUEUE_MASK];
+#endif
+    }
+    keybTxTail = keybTxTail + 1;
+    return true;
+}
+
+// READY off holds both lines. Scancodes wait in the TX queue (and, once that's full, in the
+// event ring and as held back HID reports), mouse motion keeps adding up, and whatever is
+// owed goes out as soon as READY is back: the queued scancodes back to back, and the mouse
+// packet for a poll that came in meanwhile.
+void PLATFORM_RAM_FUNC(x68kSetTxInhibit)(bool inhibit)
+{
+    bool resumed = !inhibit && txInhibit;
+    if (inhibit && !txInhibit)
+        txInhibitStart = platformTimeUs();
+    else if (resumed)
+        x68kCounters.txInhibitUs += platformTimeUs() - txInhibitStart;
+
+    txInhibit = inhibit;
+    x68kKeybTxKick();
+
+    if (resumed && mouseOwed)
+    {
+        mouseOwed = false;
+        x68kSendMouse();
+    }
+}
+
+// These are taken from the 'X68000 Technical Guide.pdf', Chapter 5.
+
+#define KEYB_MSCTRL                 0b01000000
+#define KEYB_MSCTRL_MASK            0b11111000
+#define KEYB_LED_BRIGHTNESS         0b01010100
+#define KEYB_LED_BRIGHTNESS_MASK    0b11111100
+#define KEYB_KEY_INHIBIT            0b01011000
+#define KEYB_KEY_INHIBIT_MASK       0b11111000
+#define KEYB_REPEAT_DELAY           0b01100000
+#define KEYB_REPEAT_INTERVAL        0b01110000
+#define KEYB_REPEAT_MASK            0b11110000
+#define KEYB_LED_CTRL_MASK          0b10000000
+#define KEYB_LED_KANA               0b00000001  // LED control bits, 0 = lit
+#define KEYB_LED_CAPS               0b00001000
+
+#if MOUSE_PREDICT
+// MSCTRL cadence, learned from the requests. The X68000 polls from its vertical blank, so the
+// period is steady; a request far off it (a missed poll, a mode change) drops the lock and the
+// next interval starts over.
+#define MSCTRL_MIN_PERIOD_US        2000
+#define MSCTRL_MAX_PERIOD_US        100000
+
+static uint32_t msctrlLast          = 0;    // time of the last request
+static uint32_t msctrlPeriod        = 0;    // smoothed interval in us, 0 = not locked
+
+// Packet for the current motion and button state, built ahead of the next MSCTRL. Cleared
+// whenever that state changes, so a prebuilt packet is always the one that'd be built now.
+static MouseData mousePrebuilt;
+static bool mousePrebuiltValid      = false;
+
+static void PLATFORM_RAM_FUNC(learnMsctrlPeriod)(uint32_t now)
+{
+    uint32_t interval = now - msctrlLast;
+    bool first = msctrlLast == 0;
+    msctrlLast = now ? now : 1;
+    if (first)
+        return;
+
+    if (interval < MSCTRL_MIN_PERIOD_US || interval > MSCTRL_MAX_PERIOD_US)
+        msctrlPeriod = 0;
+    else if (!msctrlPeriod)
+        msctrlPeriod = interval;
+    else if (interval > msctrlPeriod + msctrlPeriod / 4 || interval < msctrlPeriod - msctrlPeriod / 4)
+        msctrlPeriod = 0;
+    else
+        msctrlPeriod = msctrlPeriod + ((int32_t)(interval - msctrlPeriod) >> 3);
+}
+
+uint32_t x68kMsctrlPeriod(void)
+{
+    return msctrlPeriod;
+}
+#endif
+
+uint8_t x68kHidLeds(void)
+{
+    // Only KANA and CAPS have a HID usage; the rest (romaji, code input, INS, hiragana,
+    // zenkaku) and the brightness stay on the X68000 side
+    uint8_t led = ~currentLedState;
+    uint8_t leds = 0;
+    if (led & KEYB_LED_KANA)
+        leds |= HID_LED_KANA;
+    if (led & KEYB_LED_CAPS)
+        leds |= HID_LED_CAPS_LOCK;
+    return leds;
+}
+
+void PLATFORM_RAM_FUNC(x68kMsctrlRequest)(void)
+{
+    uint32_t now = platformTimeUs();
+    lastCommandUs = now;
+#if LATENCY_STATS
+    if (msctrlTimestamp)
+        latencyRecord(&latencyMsctrlPoll, now - msctrlTimestamp);
+    msctrlTimestamp = now;
+#endif
+    ++x68kCounters.msctrlRequests;
+    x68kSendMouse();
+
+#if MOUSE_PREDICT
+    learnMsctrlPeriod(now);
+    if (msctrlPeriod > MOUSE_PREBUILD_US)
+        x68kStartMouseTimer(msctrlPeriod - MOUSE_PREBUILD_US);
+#endif
+}
+
+void PLATFORM_RAM_FUNC(x68kCommand)(uint8_t ch)
+{
+    lastCommandUs = platformTimeUs();
+
+    if ((ch & KEYB_MSCTRL_MASK) == KEYB_MSCTRL)
+    {
+        bool wasAsserted = msctrlAsserted;
+        msctrlAsserted = (ch & 0x01) == 0;
+        if (!wasAsserted && msctrlAsserted)
+            x68kMsctrlRequest();
+    }
+    else if ((ch & KEYB_LED_BRIGHTNESS_MASK) == KEYB_LED_BRIGHTNESS)
+    {
+        uint8_t led_value = ch & 0x03;
+        currentLedLevel = led_value;
+    }
+    else if ((ch & KEYB_KEY_INHIBIT_MASK) == KEYB_KEY_INHIBIT)
+    {
+        bool wasInhibited = keyInhibit;
+        keyInhibit = (ch & 0x01) == 0;
+        if (wasInhibited && !keyInhibit)
+            x68kKeybTxKick();
+    }
+    else if ((ch & KEYB_REPEAT_MASK) == KEYB_REPEAT_DELAY)
+    {
+        uint16_t delayMS = 200 + (ch & 0x0f) * 100;
+        keyRepeatDelay = delayMS;
+    }
+    else if ((ch & KEYB_REPEAT_MASK) == KEYB_REPEAT_INTERVAL)
+    {
+        uint16_t v = (ch & 0x0f);
+        uint16_t intervalMS = 30 + v * v * 5;
+        keyRepeatInterval = intervalMS;
+    }
+    else if ((ch & KEYB_LED_CTRL_MASK) == KEYB_LED_CTRL_MASK)
+    {
+        uint8_t led = ch & 0x7f;
+        currentLedState = led;
+    }
+}
+
+// Key repeat runs off a timer, so the cadence doesn't depend on the main loop
+
+uint32_t PLATFORM_RAM_FUNC(keyRepeatTick)(void)
+{
+    if (!keyRepeatScan)
+        return 0;
+
+    // send repeat, after whatever else is queued; one that is still waiting from the last
+    // tick is stale, this one replaces it
+    if (!keybTxInhibited())
+    {
+        uint32_t status = platformCriticalEnter();
+        if (keybTxRepeat)
+            ++x68kCounters.repeatsDropped;
+        keybTxRepeat = keyRepeatScan;
+        platformCriticalExit(status);
+
+        x68kActivity();
+        x68kKeybTxKick();
+    }
+
+    return (uint32_t)keyRepeatInterval * 1000;
+}
+
+static void PLATFORM_RAM_FUNC(stopKeyRepeat)()
+{
+    x68kStopRepeatTimer();
+    keyRepeatScan = 0;
+    keybTxRepeat = 0;
+}
+
+static void PLATFORM_RAM_FUNC(startKeyRepeat)(uint8_t scan)
+{
+    stopKeyRepeat();
+
+    keyRepeatScan = scan;
+    x68kStartRepeatTimer((uint32_t)keyRepeatDelay * 1000);
+}
+
+// Macros (see macro.h) run off their own timer, like key repeat. Each wait counts from the
+// previous deadline, so IRQ latency doesn't add up over a sequence. A scancode is only queued
+// with at most MACRO_MAX_BACKLOG others ahead of it, otherwise the step is put off by one byte
+// time: a busy line then slows the sequence down rather than piling up a backlog behind it.
+
+#define MACRO_SLOTS                 2   // sequences running at once
+#define MACRO_MAX_BACKLOG           1
+
+typedef struct
+{
+    uint8_t  macro;                 // index + 1, 0 = free
+    uint8_t  pc;
+    bool     keyHeld;
+    bool     releasing;             // sending the BREAKs for what it still holds
+    uint32_t due;
+    uint32_t held[4];               // scancodes made and not broken yet
+} MacroSlot;
+
+static MacroSlot macroSlots[MACRO_SLOTS];
+
+// Keys the USB keyboards hold, as passed on from the event ring
+static uint32_t keysDown[4];
+
+static bool PLATFORM_RAM_FUNC(scanBit)(uint32_t const* bitmap, uint8_t scan)
+{
+    return bitmap[scan >> 5] & (1u << (scan & 31));
+}
+
+static bool PLATFORM_RAM_FUNC(macrosHold)(uint8_t scan, MacroSlot const* except)
+{
+    for (int i = 0; i < MACRO_SLOTS; ++i)
+    {
+        if (&macroSlots[i] != except && scanBit(macroSlots[i].held, scan))
+            return true;
+    }
+    return false;
+}
+
+// A key held by the keyboards and macros at once goes down with the first make and up with
+// the last break, like one held on two keyboards (see scanRefCount in hid_translate.c). A
+// make or break that doesn't change anything for the X68000 counts as sent.
+static bool PLATFORM_RAM_FUNC(macroQueueScan)(MacroSlot const* slot, uint8_t op)
+{
+    uint8_t scan = op & 0x7f;
+    if (scanBit(keysDown, scan) || macrosHold(scan, slot))
+        return true;
+
+    if (keybTxInhibited() || (uint8_t)(keybTxHead - keybTxTail) > MACRO_MAX_BACKLOG)
+        return false;
+    return keybTxQueueScan(op, 0);
+}
+
+// The same from the keyboard side. Returns false if the TX queue is full.
+static bool PLATFORM_RAM_FUNC(keyQueueScan)(uint8_t op, uint32_t timestamp)
+{
+    uint8_t scan = op & 0x7f;
+
+    uint32_t status = platformCriticalEnter();
+    bool queued = macrosHold(scan, NULL) || keybTxQueueScan(op, timestamp);
+    if (queued && (op & 0x80))
+        keysDown[scan >> 5] &= ~(1u << (scan & 31));
+    else if (queued)
+        keysDown[scan >> 5] |= 1u << (scan & 31);
+    platformCriticalExit(status);
+
+    return queued;
+}
+
+// Runs a slot up to its next wait, or until the line is too busy. Returns false once it's done.
+static bool PLATFORM_RAM_FUNC(runMacroSlot)(MacroSlot* slot, uint32_t now)
+{
+    Macro const* macro = macroGet(slot->macro - 1);
+    if (!macro)
+        slot->releasing = true;
+
+    while (!slot->releasing)
+    {
+        if (slot->pc >= macro->len)
+        {
+            if (!(macro->flags & MACRO_LOOP) || !slot->keyHeld)
+                break;
+            slot->pc = 0;
+        }
+
+        uint8_t op = macro->code[slot->pc];
+        if (op == MACRO_WAIT)
+        {
+            slot->due += macro->code[slot->pc + 1] * 1000;
+            slot->pc += 2;
+            return true;
+        }
+
+        if (!macroQueueScan(slot, op))
+        {
+            slot->due = now + MACRO_BYTE_US;
+            ++x68kCounters.macroStalls;
+            return true;
+        }
+
+        uint8_t scan = op & 0x7f;
+        if (op & 0x80)
+            slot->held[scan >> 5] &= ~(1u << (scan & 31));
+        else
+            slot->held[scan >> 5] |= 1u << (scan & 31);
+        ++slot->pc;
+    }
+
+    slot->releasing = true;
+    for (uint32_t w = 0; w < 4; ++w)
+    {
+        while (slot->held[w])
+        {
+            uint32_t bit = __builtin_ctz(slot->held[w]);
+            if (!macroQueueScan(slot, 0x80 | (w << 5) | bit))
+            {
+                slot->due = now + MACRO_BYTE_US;
+                ++x68kCounters.macroStalls;
+                return true;
+            }
+            slot->held[w] &= ~(1u << bit);
+        }
+    }
+
+    slot->macro = 0;
+    return false;
+}
+
+// Runs the slots that are due; returns the time to the next deadline, 0 if none is left
+static uint32_t PLATFORM_RAM_FUNC(runMacros)(void)
+{
+    uint32_t now = platformTimeUs();
+    uint8_t head = keybTxHead;
+    uint32_t next = 0;
+
+    for (int i = 0; i < MACRO_SLOTS; ++i)
+    {
+        MacroSlot* slot = &macroSlots[i];
+        if (!slot->macro)
+            continue;
+
+        if ((int32_t)(slot->due - now) <= 0 && !runMacroSlot(slot, now))
+            continue;
+
+        int32_t until = slot->due - now;
+        uint32_t wait = until > 0 ? until : 1;
+        if (!next || wait < next)
+            next = wait;
+    }
+
+    if (keybTxHead != head)
+    {
+        x68kActivity();
+        x68kKeybTxKick();
+    }
+    return next;
+}
+
+uint32_t PLATFORM_RAM_FUNC(keyMacroTick)(void)
+{
+    return runMacros();
+}
+
+// From the event consumer, which the macro timer can interrupt
+static void PLATFORM_RAM_FUNC(startMacro)(uint8_t index)
+{
+    uint32_t status = platformCriticalEnter();
+
+    MacroSlot* free = NULL;
+    bool running = false;
+    for (int i = 0; i < MACRO_SLOTS; ++i)
+    {
+        if (macroSlots[i].macro == index + 1 && !macroSlots[i].releasing)
+        {
+            macroSlots[i].keyHeld = true;
+            running = true;
+        }
+        else if (!macroSlots[i].macro && !free)
+        {
+            free = &macroSlots[i];
+        }
+    }
+
+    if (!running && free)
+        *free = (MacroSlot){ .macro = index + 1, .keyHeld = true, .due = platformTimeUs() };
+    else if (!running)
+        ++x68kCounters.macrosDropped;
+
+    uint32_t next = runMacros();
+    platformCriticalExit(status);
+
+    if (next)
+        x68kStartMacroTimer(next);
+}
+
+// A loop stops right away, a single run plays to its end
+static void PLATFORM_RAM_FUNC(stopMacro)(uint8_t index)
+{
+    uint32_t status = platformCriticalEnter();
+
+    Macro const* macro = macroGet(index);
+    for (int i = 0; i < MACRO_SLOTS; ++i)
+    {
+        MacroSlot* slot = &macroSlots[i];
+        if (slot->macro != index + 1 || slot->releasing)
+            continue;
+
+        slot->keyHeld = false;
+        if (macro && (macro->flags & MACRO_LOOP))
+        {
+            slot->releasing = true;
+            slot->due = platformTimeUs();
+        }
+    }
+
+    uint32_t next = runMacros();
+    platformCriticalExit(status);
+
+    if (next)
+        x68kStartMacroTimer(next);
+}
+
+static int8_t PLATFORM_RAM_FUNC(clampInt8)(int32_t value)
+{
+    return value > INT8_MAX ? INT8_MAX : value < INT8_MIN ? INT8_MIN : value;
+}
+
+static MouseData PLATFORM_RAM_FUNC(buildMousePacket)()
+{
+    MouseData mdata =
+    {
+        .Lbtn  = lmbPressed,
+        .Rbtn  = rmbPressed,
+        .dx = clampInt8(dx),
+        .dy = clampInt8(dy),
+    };
+    return mdata;
+}
+
+#if MOUSE_PREDICT
+void PLATFORM_RAM_FUNC(x68kMousePrebuild)(void)
+{
+    uint32_t status = platformCriticalEnter();
+    mousePrebuilt = buildMousePacket();
+    mousePrebuiltValid = true;
+    platformCriticalExit(status);
+}
+#endif
+
+bool PLATFORM_RAM_FUNC(x68kMousePacket)(MouseData* packet)
+{
+    // Sent once READY is back, with the motion up to then
+    if (txInhibit)
+    {
+        if (!mouseOwed)
+            ++x68kCounters.msctrlDeferred;
+        mouseOwed = true;
+        return false;
+    }
+
+#if MOUSE_PREDICT
+    MouseData mdata = mousePrebuiltValid ? mousePrebuilt : buildMousePacket();
+    mousePrebuiltValid = false;
+#else
+    MouseData mdata = buildMousePacket();
+#endif
+    *packet = mdata;
+
+    // Keep the remainder for the next poll
+    dx -= mdata.dx;
+    dy -= mdata.dy;
+
+#if LATENCY_STATS
+    uint32_t now = platformTimeUs();
+    latencyRecord(&latencyMsctrl, now - msctrlTimestamp);
+    if (mouseStamped)
+    {
+        latencyRecord(&latencyMouseSend, now - mouseTimestamp);
+        mouseStamped = dx || dy;
+    }
+#endif
+
+    return true;
+}
+
+#if MOUSE_ACCEL
+// Gain (8.8 fixed point) by pointer speed in USB counts per ms
+static const uint16_t mouseAccelCurve[] PLATFORM_SCRATCH_X("mouseAccelCurve") =
+{
+    256, 256, 256, 272, 296, 320, 344, 368, 392, 416, 440, 464, 488, 512, 512, 512,
+};
+
+#define MOUSE_ACCEL_STEPS   (sizeof(mouseAccelCurve) / sizeof(mouseAccelCurve[0]))
+
+static uint32_t mouseLastTimestamp  = 0;
+#endif
+
+// Sub-count motion left over from scaling, 8.8 fixed point
+static int32_t mouseFractionX       = 0;
+static int32_t mouseFractionY       = 0;
+
+static uint32_t PLATFORM_RAM_FUNC(mouseGain)(InputEvent const* event)
+{
+#if MOUSE_ACCEL
+    // Normalise by the report interval so 125 Hz and 1000 Hz mice get the same curve
+    uint32_t elapsed = event->timestamp - mouseLastTimestamp;
+    mouseLastTimestamp = event->timestamp;
+    if (elapsed < 1000)
+        elapsed = 1000;
+
+    uint32_t distanceX = abs(event->dx), distanceY = abs(event->dy);
+    uint32_t speed = (distanceX > distanceY ? distanceX : distanceY) * 1000 / elapsed;
+    if (speed >= MOUSE_ACCEL_STEPS)
+        speed = MOUSE_ACCEL_STEPS - 1;
+    return (mouseScale * mouseAccelCurve[speed]) >> 8;
+#else
+    (void)event;
+    return mouseScale;
+#endif
+}
+
+static int32_t PLATFORM_RAM_FUNC(scaleMotion)(int32_t delta, uint32_t gain, int32_t* fraction)
+{
+    int32_t scaled = delta * (int32_t)gain + *fraction;
+    int32_t counts = scaled >> 8;
+    *fraction = scaled - (counts << 8);
+    return counts;
+}
+
+static int32_t PLATFORM_RAM_FUNC(clampBacklog)(int32_t value)
+{
+    return value > MOUSE_MAX_BACKLOG ? MOUSE_MAX_BACKLOG : value < -MOUSE_MAX_BACKLOG ? -MOUSE_MAX_BACKLOG : value;
+}
+
+// Called with the MSCTRL/UART IRQs possibly firing, which read and clear the same state
+static void PLATFORM_RAM_FUNC(accumulateMouse)(InputEvent const* event)
+{
+    uint32_t gain = mouseGain(event);
+    int32_t moveX = scaleMotion(event->dx, gain, &mouseFractionX);
+    int32_t moveY = scaleMotion(event->dy, gain, &mouseFractionY);
+
+    uint32_t status = platformCriticalEnter();
+    lmbPressed = event->buttons & MOUSE_BUTTON_LEFT;
+    rmbPressed = event->buttons & MOUSE_BUTTON_RIGHT;
+    dx = clampBacklog(dx + moveX);
+    dy = clampBacklog(dy + moveY);
+#if MOUSE_PREDICT
+    mousePrebuiltValid = false;
+#endif
+#if LATENCY_STATS
+    if (!mouseStamped)
+    {
+        mouseTimestamp = event->timestamp;
+        mouseStamped = true;
+    }
+#endif
+    platformCriticalExit(status);
+}
+
+void PLATFORM_RAM_FUNC(processKeybAndMouse)(void)
+{
+    InputEvent const* event;
+    while ((event = eventRingPeek(&inputEvents)))
+    {
+        if (event->type == EVENT_KEY)
+        {
+            // Leave it in the ring until the TX queue has room again
+            if (!keyQueueScan(event->scan, event->timestamp ? event->timestamp : 1))
+                break;
+
+#if LATENCY_STATS
+            latencyRecord(&latencyKeyQueue, platformTimeUs() - event->timestamp);
+#endif
+
+            x68kActivity();
+
+            // Record the most recent KEYDOWN, or reset it
+            uint8_t scan = event->scan & 0x7f;
+            if (!(event->scan & 0x80))
+            {
+                if (event->flags & EVENT_FLAG_REPEAT)
+                    startKeyRepeat(scan);
+            }
+            else
+            {
+                if (keyRepeatScan == scan)
+                    stopKeyRepeat();
+            }
+        }
+        else if (event->type == EVENT_MOUSE)
+        {
+            accumulateMouse(event);
+        }
+        else if (event->type == EVENT_MACRO)
+        {
+            if (event->scan & 0x80)
+                stopMacro(event->scan & 0x7f);
+            else
+                startMacro(event->scan);
+        }
+
+        eventRingPop(&inputEvents);
+    }
+
+    // Fallback in case the TX IRQ edge was missed
+    x68kKeybTxKick();
+}
+
+// Settings from the config store; the repeat ones hold until the X68000 sends its own
+void x68kLoadConfig(X68kConfig const* config)
+{
+    keyRepeatDelay = config->repeatDelayMs;
+    keyRepeatInterval = config->repeatIntervalMs;
+    mouseScale = config->mouseScale;
+}
+
+// The repeat settings the X68000 sent last become the ones to start with next time
+void x68kStoreConfig(X68kConfig* config)
+{
+    config->repeatDelayMs = keyRepeatDelay;
+    config->repeatIntervalMs = keyRepeatInterval;
+    config->mouseScale = mouseScale;
+}
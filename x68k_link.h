@@ -0,0 +1,154 @@
+#ifndef _X68K_LINK_H_
+#define _X68K_LINK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "config.h"
+
+// X68000 side: consumes the input events, queues keyboard scancodes, decodes the commands
+// the X68000 sends on the keyboard line, runs key repeat and builds the mouse packets.
+// Like hid_translate.c it makes no hardware calls. What it needs from the hardware goes
+// through the x68k* hooks at the bottom, which main.c (or the host harness) provides.
+
+// Mouse motion: USB counts are scaled by MOUSE_SCALE (8.8 fixed point, 256 = 1:1), and by the
+// acceleration curve if MOUSE_ACCEL is set. Motion that doesn't fit in one X68000 packet is
+// sent on the following MSCTRL polls, up to MOUSE_MAX_BACKLOG counts per axis.
+#ifndef MOUSE_SCALE
+#define MOUSE_SCALE         256
+#endif
+#ifndef MOUSE_ACCEL
+#define MOUSE_ACCEL         0
+#endif
+#ifndef MOUSE_MAX_BACKLOG
+#define MOUSE_MAX_BACKLOG   512
+#endif
+
+// Learn the MSCTRL period and build the next mouse packet MOUSE_PREBUILD_US ahead of the
+// expected request (1), so the request only has to start sending it. Motion that arrives in
+// between throws the packet away again; or build the packet on the request (0). Off by
+// default: building one is two clamps and a byte pack, while the prebuild timer costs an
+// alarm cancel and re-add on every MSCTRL edge, and no gain has been measured so far.
+#ifndef MOUSE_PREDICT
+#define MOUSE_PREDICT       0
+#endif
+#ifndef MOUSE_PREBUILD_US
+#define MOUSE_PREBUILD_US   500
+#endif
+
+// Record USB report to X68000 byte latencies (1), or leave them out (0)
+#ifndef LATENCY_STATS
+#define LATENCY_STATS       0
+#endif
+
+typedef struct 
+{
+    union
+    {
+        uint8_t data[3];
+        struct
+        {
+            union
+            {
+                struct
+                {
+                    uint8_t Lbtn:1;
+                    uint8_t Rbtn:1;
+                    uint8_t unused:2;
+                    uint8_t Xover:1;
+                    uint8_t Xundr:1;
+                    uint8_t Yover:1;
+                    uint8_t Yundr:1;
+                };
+                uint8_t state;
+            };
+            int8_t  dx;
+            int8_t  dy;
+        };
+    };
+    
+} MouseData;
+
+// Drains the input event ring into the keyboard TX queue and the mouse state
+void processKeybAndMouse(void);
+
+// One byte from the X68000 (MSCTRL, LED, key inhibit, repeat delay/interval)
+void x68kCommand(uint8_t ch);
+
+// MSCTRL asserted, by the GPIO line or by command; calls x68kSendMouse()
+void x68kMsctrlRequest(void);
+
+// READY line, true while the X68000 holds it off
+void x68kSetTxInhibit(bool inhibit);
+
+// Keyboard TX queue, drained by the platform one byte at a time. keybTxPop() returns false
+// when the queue is empty or the X68000 doesn't want any more bytes right now.
+bool keybTxPending(void);
+bool keybTxPop(uint8_t* scan);
+
+// How long it's been since the last command byte or MSCTRL from the X68000; 0 while MSCTRL
+// is asserted or keyboard bytes are queued. The UARTs and lines themselves are up to the platform.
+uint32_t x68kLinkQuietUs(void);
+
+// Builds the next mouse packet and keeps whatever didn't fit for the next one.
+// Returns false if nothing may be sent right now.
+bool x68kMousePacket(MouseData* packet);
+
+// Call from the key repeat timer; returns the time to the next repeat in us, or 0 to stop
+uint32_t keyRepeatTick(void);
+
+// Call from the macro timer; returns the time to the next step in us (from now), or 0 to stop
+uint32_t keyMacroTick(void);
+
+// The LEDs the X68000 last asked for, as HID_LED_xxx for the USB keyboards
+uint8_t x68kHidLeds(void);
+
+// To and from the config store (config.h)
+void x68kLoadConfig(X68kConfig const* config);
+void x68kStoreConfig(X68kConfig* config);
+
+#if MOUSE_PREDICT
+// Call from the mouse timer, ahead of the next MSCTRL request
+void x68kMousePrebuild(void);
+
+// Learned MSCTRL period in us, 0 while there isn't a steady one
+uint32_t x68kMsctrlPeriod(void);
+#endif
+
+#if LATENCY_STATS
+#include "latency.h"
+
+// Timestamps are time_us_32(); differences stay correct across the wrap
+extern LatencyHistogram latencyKeyQueue;    // HID report -> scancode in the TX queue
+extern LatencyHistogram latencyKeySend;     // HID report -> scancode written to the UART
+extern LatencyHistogram latencyMouseSend;   // HID report -> mouse packet started
+extern LatencyHistogram latencyMsctrl;      // MSCTRL request -> mouse packet started
+extern LatencyHistogram latencyMsctrlPoll;  // MSCTRL request -> next MSCTRL request
+#endif
+
+// Always-on counters, each written from one context only
+typedef struct
+{
+    uint32_t msctrlRequests;
+    uint32_t keybQueueHighWater;    // most scancodes ever waiting in the TX queue
+    uint32_t repeatsDropped;        // key repeats replaced by a newer one before going out
+    uint32_t txInhibitUs;           // total time READY held the keyboard line off
+    uint32_t msctrlDeferred;        // mouse polls answered late, as READY was off
+    uint32_t macroStalls;           // macro steps put off as the keyboard line was busy
+    uint32_t macrosDropped;         // macro key presses with no free slot to run in
+} X68kCounters;
+
+extern X68kCounters x68kCounters;
+
+// Hooks provided by the platform
+void x68kKeybTxKick(void);                      // start sending if idle
+void x68kSendMouse(void);                       // send x68kMousePacket(), if it can
+void x68kStartRepeatTimer(uint32_t delayUs);    // call keyRepeatTick() after delayUs
+void x68kStopRepeatTimer(void);
+void x68kStartMacroTimer(uint32_t delayUs);     // (re)arm for keyMacroTick() after delayUs
+#if MOUSE_PREDICT
+void x68kStartMouseTimer(uint32_t delayUs);     // call x68kMousePrebuild() after delayUs
+#endif
+void x68kActivity(void);                        // flash the activity LED
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef _X68K_PLATFORM_H_
+#define _X68K_PLATFORM_H_
+
+#include <stdint.h>
+
+// The few primitives hid_translate.c and x68k_link.c need, for the firmware or for the host
+// build (X68K_HOST, see host/). Kept inline as they sit in the per-event paths.
+
+#if X68K_HOST
+
+uint32_t hostTimeUs(void);      // simulated time, provided by the host harness
+
+static inline uint32_t platformTimeUs(void)             { return hostTimeUs(); }
+static inline uint32_t platformCriticalEnter(void)      { return 0; }
+static inline void platformCriticalExit(uint32_t status) { (void)status; }
+static inline void platformWakeConsumer(void)           { }
+static inline void platformCompilerBarrier(void)        { __asm volatile ("" ::: "memory"); }
+
+#define PLATFORM_SCRATCH_X(name)
+#define PLATFORM_RAM_FUNC(name)                         name
+
+#else
+
+#include "pico/time.h"
+#include "hardware/sync.h"
+
+static inline uint32_t platformTimeUs(void)             { return time_us_32(); }
+static inline uint32_t platformCriticalEnter(void)      { return save_and_disable_interrupts(); }
+static inline void platformCriticalExit(uint32_t status) { restore_interrupts(status); }
+static inline void platformWakeConsumer(void)           { __sev(); }   // wake the other core
+static inline void platformCompilerBarrier(void)        { __compiler_memory_barrier(); }
+
+// Data in the 4 KB scratch X bank, away from the main SRAM the DMA uses. The top of the bank
+// is core1's stack (PICO_CORE1_STACK_SIZE, 2 KB by default), which the link runs on with
+// X68K_ON_CORE1. The tables here (keyScans, the macros and the mouse acceleration curve,
+// under 512 bytes) sit below it, and linking fails with "region SCRATCH_X overflowed" if the
+// two ever meet. RAM code, such as the repeat timer hooks, goes to main SRAM instead.
+#define PLATFORM_SCRATCH_X(name)                        __scratch_x(name)
+
+// Code run from SRAM, so an XIP cache miss can't delay it
+#define PLATFORM_RAM_FUNC(name)                         __not_in_flash_func(name)
+
+#endif
+
+#endif